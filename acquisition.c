@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    acquisition.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+
+#include "acquisition.h"
+#include "mpu6050.h"
+#include "scheduler.h"
+#include "thread_wrapper.h"
+#include "trace.h"
+#include "log.h"
+
+struct acquisition_sensor {
+    struct mpu6050 dev;
+    uint8_t id;
+};
+
+struct acquisition_bus {
+    int number;
+    int fd;
+    sThread_t thread;
+    struct scheduler sched;
+    int sample_job;
+    struct acquisition_sensor sensors[ACQUISITION_MAX_SENSORS];
+    unsigned sensor_count;
+};
+
+static struct acquisition_bus m_buses[ACQUISITION_MAX_BUSES];
+static unsigned m_bus_count = 0;
+static unsigned m_sensor_count = 0;
+static AcquisitionSink_t m_sink = NULL;
+
+// Samples every sensor of one bus
+static void acquisition_sample_bus(void *param) {
+    struct acquisition_bus *bus = (struct acquisition_bus *)param;
+    struct acquisition_sample sample;
+
+    for (unsigned i = 0; i < bus->sensor_count; i++) {
+        int err;
+
+        TRACE(TRACE_EV_SENSOR_READ_START, bus->sensors[i].id, bus->number);
+        err = mpu6050_read_motion(&bus->sensors[i].dev, sample.accel, sample.gyro);
+        TRACE(TRACE_EV_SENSOR_READ_END, bus->sensors[i].id, err);
+        if (err)
+            continue;
+        sample.sensor_id = bus->sensors[i].id;
+        m_sink(&sample);
+    }
+}
+
+// One scheduler per bus: buses run in parallel, each on its own deadlines
+static void *acquisition_thread(void *param) {
+    struct acquisition_bus *bus = (struct acquisition_bus *)param;
+
+    if (scheduler_run(&bus->sched))
+        LOG_ERROR("Acquisition timer failure on bus %d\n", bus->number);
+    return NULL;
+}
+
+int acquisition_add_sensor(int bus, uint8_t addr) {
+    struct acquisition_bus *target = NULL;
+
+    if (m_sensor_count >= ACQUISITION_MAX_SENSORS)
+        return -1;
+
+    for (unsigned i = 0; i < m_bus_count; i++) {
+        if (m_buses[i].number == bus) {
+            target = &m_buses[i];
+            break;
+        }
+    }
+    if (target == NULL) {
+        if (m_bus_count >= ACQUISITION_MAX_BUSES)
+            return -1;
+        target = &m_buses[m_bus_count++];
+        target->number = bus;
+        target->fd = -1;
+        target->sensor_count = 0;
+    }
+
+    target->sensors[target->sensor_count].dev.addr = addr;
+    target->sensors[target->sensor_count].id = (uint8_t)m_sensor_count;
+    target->sensor_count++;
+    return (int)m_sensor_count++;
+}
+
+unsigned acquisition_sensor_count() {
+    return m_sensor_count;
+}
+
+int acquisition_start(unsigned sample_rate_hz, AcquisitionSink_t sink) {
+    if (sample_rate_hz == 0 || sink == NULL || m_sensor_count == 0)
+        return 1;
+
+    m_sink = sink;
+
+    for (unsigned i = 0; i < m_bus_count; i++) {
+        struct acquisition_bus *bus = &m_buses[i];
+
+        bus->fd = mpu6050_bus_open(bus->number);
+        if (bus->fd < 0)
+            return 1;
+
+        for (unsigned j = 0; j < bus->sensor_count; j++) {
+            if (mpu6050_open(&bus->sensors[j].dev, bus->fd, bus->sensors[j].dev.addr)) {
+                printf("Failed to configure sensor %d (bus %d, 0x%02x)\n",
+                       bus->sensors[j].id, bus->number, bus->sensors[j].dev.addr);
+                return 1;
+            }
+        }
+
+        if (scheduler_init(&bus->sched))
+            return 1;
+        bus->sample_job = scheduler_add(&bus->sched, "sample", SCHEDULER_PERIOD_HZ(sample_rate_hz),
+                                        acquisition_sample_bus, bus);
+    }
+
+    for (unsigned i = 0; i < m_bus_count; i++) {
+        if (threadCreate(&m_buses[i].thread, "I2C-Acq", acquisition_thread, &m_buses[i]))
+            return 1;
+    }
+    return 0;
+}
+
+int acquisition_get_stats(unsigned bus_index, struct scheduler_stats *stats) {
+    if (bus_index >= m_bus_count)
+        return -1;
+
+    scheduler_get_stats(&m_buses[bus_index].sched, m_buses[bus_index].sample_job, stats);
+    return m_buses[bus_index].number;
+}
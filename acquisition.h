@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * @file    acquisition.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef ACQUISITION_H_
+#define ACQUISITION_H_
+#include <stdint.h>
+
+#include "scheduler.h"
+
+// Limits of sensors and buses driven by one client
+#define ACQUISITION_MAX_SENSORS     16
+#define ACQUISITION_MAX_BUSES       8
+
+struct acquisition_sample {
+    uint8_t sensor_id;              // Order in which the sensor was added
+    int16_t accel[3];               // Raw counts
+    int16_t gyro[3];
+};
+
+/**
+ * @brief Receives every sample. Called from the acquisition thread of the
+ * sensor's bus, so samples of sensors on different buses arrive in parallel.
+ */
+typedef void (*AcquisitionSink_t) (const struct acquisition_sample *sample);
+
+/**
+ * @brief Declare a sensor. Sensor ids follow the order of the calls.
+ * @param bus: I2C bus number (/dev/i2c-<bus>)
+ * @param addr: Device address (MPU6050_ADDR_AD0_LOW or MPU6050_ADDR_AD0_HIGH)
+ * @return Sensor id, or -1 when the limits are reached
+ */
+int acquisition_add_sensor(int bus, uint8_t addr);
+
+/**
+ * @brief Number of declared sensors
+ */
+unsigned acquisition_sensor_count();
+
+/**
+ * @brief Open the buses, configure the sensors and start one thread per bus.
+ * Each thread samples its bus on a timerfd scheduler, at absolute deadlines.
+ * @param sample_rate_hz: Sampling rate of every sensor
+ * @param sink: Sample consumer
+ * @return 0 on success, 1 on failure
+ */
+int acquisition_start(unsigned sample_rate_hz, AcquisitionSink_t sink);
+
+/**
+ * @brief Sampling statistics of a bus, valid after acquisition_start
+ * @param bus_index: 0 up to the number of distinct buses
+ * @param stats: Statistics of the sampling job of the bus
+ * @return I2C bus number, or -1 when there is no such bus
+ */
+int acquisition_get_stats(unsigned bus_index, struct scheduler_stats *stats);
+
+#endif /* ACQUISITION_H_ */
@@ -0,0 +1,1004 @@
+/**
+ ******************************************************************************
+ * @file    bench.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "codec.h"
+#include "dispatch.h"
+#include "mpu6050.h"
+#include "rules.h"
+#include "shm_cache.h"
+#include "tcp.h"
+#include "thread_wrapper.h"
+
+/**
+ * @note Microbenchmarks of the hot functions of the server and the client:
+ * ./bench [--json] [--quick] [--check] [filter]
+ * Each result is the median of BENCH_REPEATS timed batches. With --json the
+ * output keeps the same keys and order from run to run, to diff builds.
+ * --check compares the text codec with sscanf and snprintf on random input
+ * instead, and fails on the first differences.
+ */
+
+// Batches timed per result; the median is reported
+#define BENCH_REPEATS           5
+
+// Shortest batch, in ms (--quick: BENCH_QUICK_RUN_MS)
+#define BENCH_MIN_RUN_MS        100
+#define BENCH_QUICK_RUN_MS      10
+
+// Round trips per latency result (--quick: BENCH_QUICK_RTT_SAMPLES), after the warm up
+#define BENCH_RTT_SAMPLES       50000
+#define BENCH_QUICK_RTT_SAMPLES 2000
+#define BENCH_RTT_WARMUP        1000
+
+// Samples queued between two rule evaluations
+#define BENCH_RULES_BATCH       1024
+
+// Random cases of --check, per kind
+#define BENCH_CHECK_CASES       500000
+#define BENCH_QUICK_CHECK_CASES 50000
+
+// Differences printed by --check
+#define BENCH_CHECK_REPORTED    5
+
+#define BENCH_MAX_RESULTS       64
+#define BENCH_NAME_SZ           48
+
+struct bench_result {
+    char name[BENCH_NAME_SZ];
+    uint64_t iterations;
+    double ns_per_op;
+    // Distribution of the round trips
+    bool latency;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+typedef void (*bench_fn_t)(void *ctx, uint64_t iterations);
+
+// Configurations of the TCP layer; each runs in its own process, as the
+// engine and the profile are fixed once a socket is open
+struct bench_tcp_config {
+    const char *name;
+    int engine;
+    int profile;
+    bool busy_loop;
+    bool lookup;                // Also measure the socket lookup
+};
+
+static const struct bench_tcp_config m_tcp_configs[] = {
+    {"tcp_rtt_blocking_default", TCP_ENGINE_BLOCKING, TCP_PROFILE_DEFAULT, false, true},
+    {"tcp_rtt_blocking_low_latency", TCP_ENGINE_BLOCKING, TCP_PROFILE_LOW_LATENCY, false, false},
+    {"tcp_rtt_blocking_busy_loop", TCP_ENGINE_BLOCKING, TCP_PROFILE_LOW_LATENCY, true, false},
+    {"tcp_rtt_uring_default", TCP_ENGINE_URING, TCP_PROFILE_DEFAULT, false, false},
+    {"tcp_rtt_uring_low_latency", TCP_ENGINE_URING, TCP_PROFILE_LOW_LATENCY, false, false},
+};
+
+// Client counts of the lookup results
+static const unsigned m_lookup_clients[] = {1, 2, 4, TCP_NUMBER_CLIENTS_TO_SERVER};
+
+// Message bodies as sent by the client ("%f"), after the token and the separator
+static const char *m_accel_bodies[8] = {
+    " 0.012329-0.998108-0.004028", " -0.250000-0.031250-0.968750",
+    " 1.999939-0.000061--1.999939", " 0.707092--0.707092-0.000000",
+    " -0.003113-0.010559-1.002502", " 0.500000-0.500000-0.707092",
+    " -1.250977-0.875000-0.125061", " 0.000000-0.000000-1.000000",
+};
+
+static const char *m_quat_bodies[4] = {
+    " 0.999981-0.001234-0.005678--0.000321", " 0.707107-0.000000-0.707107-0.000000",
+    " 0.923880-0.382683-0.000000-0.000000", " 0.500000--0.500000-0.500000--0.500000",
+};
+
+static const char m_single_message[] = "Accel#2: 0.012329-0.998108-0.004028";
+static const char m_batch_message[] =
+    "Accel#2: 0.012329-0.998108-0.004028"
+    "Gyro#2: -1.219512-0.365854-12.926829"
+    "Angles#2: 1.250000--0.750000-179.500000"
+    "Quat#2: 0.999981-0.001234-0.005678--0.000321";
+
+static int16_t m_raw[64][3];
+
+static struct bench_result m_results[BENCH_MAX_RESULTS];
+static unsigned m_result_count = 0;
+static const char *m_filter = NULL;
+static uint64_t m_min_run_ns = BENCH_MIN_RUN_MS * 1000000ull;
+static unsigned m_rtt_samples = BENCH_RTT_SAMPLES;
+
+// Keeps the measured work from being optimized away
+static volatile float m_sink;
+
+// Sockets accepted by the TCP layer, in order
+static _sSocket_t m_accepted[TCP_NUMBER_CLIENTS_TO_SERVER];
+static unsigned m_accepted_count = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static bool selected(const char *name) {
+    return m_filter == NULL || strstr(name, m_filter) != NULL;
+}
+
+static struct bench_result *new_result(const char *name) {
+    struct bench_result *res;
+
+    if (m_result_count == BENCH_MAX_RESULTS)
+        return NULL;
+    res = &m_results[m_result_count++];
+    memset(res, 0, sizeof(*res));
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    return res;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t time_batch(bench_fn_t fn, void *ctx, uint64_t iterations) {
+    uint64_t start = now_ns();
+
+    fn(ctx, iterations);
+    return now_ns() - start;
+}
+
+static void bench_run(const char *name, bench_fn_t fn, void *ctx) {
+    double ns_per_op[BENCH_REPEATS];
+    struct bench_result *res;
+    uint64_t iterations = 1;
+
+    if (!selected(name))
+        return;
+
+    // Grow the batch until it lasts long enough to time
+    while (time_batch(fn, ctx, iterations) < m_min_run_ns && iterations < (1ull << 40))
+        iterations *= 2;
+
+    for (int i = 0; i < BENCH_REPEATS; i++)
+        ns_per_op[i] = (double)time_batch(fn, ctx, iterations) / (double)iterations;
+    qsort(ns_per_op, BENCH_REPEATS, sizeof(double), compare_double);
+
+    res = new_result(name);
+    if (res == NULL)
+        return;
+    res->iterations = iterations;
+    res->ns_per_op = ns_per_op[BENCH_REPEATS / 2];
+}
+
+/******************************************************************************/
+// Parsing and formatting, as in the handlers and senders of main.c
+
+static void bench_parse_accel(void *ctx, uint64_t iterations) {
+    float acc = 0, v[3];
+    int consumed = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (sscanf(m_accel_bodies[i & 7], " %f-%f-%f%n", &v[0], &v[1], &v[2], &consumed) == 3)
+            acc += v[0] + (float)consumed;
+    }
+    m_sink = acc;
+}
+
+static void bench_parse_quat(void *ctx, uint64_t iterations) {
+    float acc = 0, q[4];
+    int consumed = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (sscanf(m_quat_bodies[i & 3], " %f-%f-%f-%f%n", &q[0], &q[1], &q[2], &q[3], &consumed) == 4)
+            acc += q[0] + (float)consumed;
+    }
+    m_sink = acc;
+}
+
+static void bench_format_delta(void *ctx, uint64_t iterations) {
+    char buffer[200];
+    float acc = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const int16_t *raw = m_raw[i & 63];
+
+        acc += (float)sprintf(buffer, "<Delta on %s>: (x %.2f, y %.2f, z %.2f)", "Accel#2",
+                              raw[0] / 1000.0f, raw[1] / 1000.0f, raw[2] / 1000.0f);
+    }
+    m_sink = acc;
+}
+
+static void bench_parse_accel_codec(void *ctx, uint64_t iterations) {
+    float acc = 0, v[3];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const char *body = m_accel_bodies[i & 7];
+        uint16_t consumed = codec_parse_floats(body, (uint16_t)strlen(body), v, 3);
+
+        if (consumed != 0)
+            acc += v[0] + (float)consumed;
+    }
+    m_sink = acc;
+}
+
+static void bench_parse_quat_codec(void *ctx, uint64_t iterations) {
+    float acc = 0, q[4];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const char *body = m_quat_bodies[i & 3];
+        uint16_t consumed = codec_parse_floats(body, (uint16_t)strlen(body), q, 4);
+
+        if (consumed != 0)
+            acc += q[0] + (float)consumed;
+    }
+    m_sink = acc;
+}
+
+static void bench_format_delta_codec(void *ctx, uint64_t iterations) {
+    char buffer[200];
+    float acc = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const int16_t *raw = m_raw[i & 63];
+        float delta[3] = {raw[0] / 1000.0f, raw[1] / 1000.0f, raw[2] / 1000.0f};
+
+        acc += (float)codec_format_delta(buffer, "Accel#2", delta);
+    }
+    m_sink = acc;
+}
+
+static void bench_format_sample(void *ctx, uint64_t iterations) {
+    char buffer[200];
+    float acc = 0;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const int16_t *raw = m_raw[i & 63];
+
+        acc += (float)sprintf(buffer, "%s: %f-%f-%f", "Accel#2",
+                              raw[0] / MPU6050_ACCEL_LSB_PER_G, raw[1] / MPU6050_ACCEL_LSB_PER_G,
+                              raw[2] / MPU6050_ACCEL_LSB_PER_G);
+    }
+    m_sink = acc;
+}
+
+/******************************************************************************/
+// Dispatch: token lookup alone, then with the body parsed
+
+static uint16_t skip_handler(uint8_t sensor_id, const char *body, uint16_t len) {
+    return len;
+}
+
+static uint16_t vector_handler(uint8_t sensor_id, const char *body, uint16_t len) {
+    float v[3];
+    int consumed = 0;
+
+    if (sscanf(body, " %f-%f-%f%n", &v[0], &v[1], &v[2], &consumed) != 3)
+        return 0;
+    m_sink = v[0];
+    return (uint16_t)consumed;
+}
+
+static uint16_t quat_handler(uint8_t sensor_id, const char *body, uint16_t len) {
+    float q[4];
+    int consumed = 0;
+
+    if (sscanf(body, " %f-%f-%f-%f%n", &q[0], &q[1], &q[2], &q[3], &consumed) != 4)
+        return 0;
+    m_sink = q[0];
+    return (uint16_t)consumed;
+}
+
+static uint16_t vector_codec_handler(uint8_t sensor_id, const char *body, uint16_t len) {
+    float v[3];
+    uint16_t consumed = codec_parse_floats(body, len, v, 3);
+
+    m_sink = v[0];
+    return consumed;
+}
+
+static uint16_t quat_codec_handler(uint8_t sensor_id, const char *body, uint16_t len) {
+    float q[4];
+    uint16_t consumed = codec_parse_floats(body, len, q, 4);
+
+    m_sink = q[0];
+    return consumed;
+}
+
+static void register_handlers(DispatchHandler_t vector, DispatchHandler_t quat) {
+    dispatch_init();
+    dispatch_register("Accel", vector);
+    dispatch_register("Gyro", vector);
+    dispatch_register("Angles", vector);
+    dispatch_register("Quat", quat);
+}
+
+static void bench_dispatch(void *ctx, uint64_t iterations) {
+    const char *message = (const char *)ctx;
+    uint16_t len = (uint16_t)strlen(message);
+    int handled = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+        handled += dispatch_message((const uint8_t *)message, len);
+    m_sink = (float)handled;
+}
+
+/******************************************************************************/
+// Rules: samples queued as by the handlers, evaluated every BENCH_RULES_BATCH
+
+static int load_rules(unsigned count) {
+    static const char *const metrics[] = {"magnitude", "any", "x", "y"};
+    char path[] = "/tmp/bench-rules-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *file;
+    int err;
+
+    if (fd < 0)
+        return 1;
+    file = fdopen(fd, "w");
+    // Thresholds above the samples: the cost without alerts
+    for (unsigned i = 0; i < count; i++)
+        fprintf(file, "r%u Accel %s > %u for %u\n", i, metrics[i % 4], 2 + i, 10 * (i % 3));
+    fclose(file);
+    err = rules_load(path);
+    unlink(path);
+    return err;
+}
+
+static void bench_rules(void *ctx, uint64_t iterations) {
+    float g[3];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        const int16_t *raw = m_raw[i & 63];
+
+        for (int axis = 0; axis < 3; axis++)
+            g[axis] = raw[axis] / 32768.0f;
+        rules_ingest(TCP_NO_SOCKET, (uint8_t)i, SHM_CACHE_ACCEL, g, 3);
+        if ((i % BENCH_RULES_BATCH) == BENCH_RULES_BATCH - 1)
+            rules_run(NULL);
+    }
+    rules_run(NULL);
+}
+
+/******************************************************************************/
+// Raw counts to physical units
+
+static void bench_convert_accel(void *ctx, uint64_t iterations) {
+    float acc = 0, g[3];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        mpu6050_accel_to_g(m_raw[i & 63], g);
+        acc += g[0] + g[1] + g[2];
+    }
+    m_sink = acc;
+}
+
+static void bench_convert_gyro(void *ctx, uint64_t iterations) {
+    float acc = 0, dps[3];
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        mpu6050_gyro_to_dps(m_raw[i & 63], dps);
+        acc += dps[0] + dps[1] + dps[2];
+    }
+    m_sink = acc;
+}
+
+/******************************************************************************/
+// Round trips of one sensor message
+
+typedef int (*round_trip_fn_t)(void *ctx, const char *message, size_t len);
+
+static int round_trip(void *ctx, const char *message, size_t len) {
+    int fd = *(int *)ctx;
+    char echo[TCP_BUFFER_SZ];
+    size_t got = 0;
+
+    if (write(fd, message, len) != (ssize_t)len)
+        return 1;
+    while (got < len) {
+        ssize_t rd = read(fd, echo + got, sizeof(echo) - got);
+
+        if (rd <= 0)
+            return 1;
+        got += (size_t)rd;
+    }
+    return 0;
+}
+
+static int bench_round_trips(const char *name, round_trip_fn_t trip, void *ctx) {
+    size_t len = strlen(m_single_message);
+    struct bench_result *res;
+    uint64_t *samples;
+    uint64_t total = 0;
+
+    samples = malloc(m_rtt_samples * sizeof(uint64_t));
+    if (samples == NULL)
+        return 1;
+
+    for (int i = 0; i < BENCH_RTT_WARMUP; i++) {
+        if (trip(ctx, m_single_message, len))
+            goto error;
+    }
+    for (unsigned i = 0; i < m_rtt_samples; i++) {
+        uint64_t start = now_ns();
+
+        if (trip(ctx, m_single_message, len))
+            goto error;
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    qsort(samples, m_rtt_samples, sizeof(uint64_t), compare_u64);
+
+    res = new_result(name);
+    if (res != NULL) {
+        res->iterations = m_rtt_samples;
+        res->ns_per_op = (double)total / m_rtt_samples;
+        res->latency = true;
+        res->p50_ns = (double)samples[m_rtt_samples / 2];
+        res->p99_ns = (double)samples[(uint64_t)m_rtt_samples * 99 / 100];
+        res->p999_ns = (double)samples[(uint64_t)m_rtt_samples * 999 / 1000];
+        res->max_ns = (double)samples[m_rtt_samples - 1];
+    }
+    free(samples);
+    return 0;
+
+error:
+    free(samples);
+    return 1;
+}
+
+static void *echo_thread(void *param) {
+    int fd = *(int *)param;
+    char buffer[TCP_BUFFER_SZ];
+    ssize_t rd;
+
+    while ((rd = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (write(fd, buffer, (size_t)rd) != rd)
+            break;
+    }
+    return NULL;
+}
+
+// Baseline without the TCP layer: a thread echoing on a socketpair
+static void bench_socketpair() {
+    sThread_t echo;
+    int fds[2];
+
+    if (!selected("socketpair_rtt"))
+        return;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+        return;
+
+    if (threadCreate(&echo, "Echo", echo_thread, &fds[1]) == 0) {
+        if (bench_round_trips("socketpair_rtt", round_trip, &fds[0]))
+            fprintf(stderr, "socketpair_rtt: echo failed\n");
+        shutdown(fds[0], SHUT_RDWR);
+        pthread_join(echo.handle, NULL);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/******************************************************************************/
+// TCP layer: the server echoes each message back from its receive callback
+
+static void tcp_echo_callback(uint8_t *buffer, uint16_t len) {
+    TCPSendData(TCPGetRxSocket(), (char *)buffer, len);
+}
+
+/******************************************************************************/
+// Local link of the TCP layer: both ends in this process, echo on the server end
+
+static uint32_t m_local_replies = 0;
+static bool m_single_core = false;
+
+static void local_reply_callback(uint8_t *buffer, uint16_t len) {
+    __atomic_add_fetch(&m_local_replies, 1, __ATOMIC_RELEASE);
+}
+
+static int local_round_trip(void *ctx, const char *message, size_t len) {
+    uint32_t expected = __atomic_load_n(&m_local_replies, __ATOMIC_ACQUIRE) + 1;
+
+    if (TCPSendData(*(_sSocket_t *)ctx, (char *)message, (uint16_t)len) != ERRCODE_NO_ERROR)
+        return 1;
+    while (__atomic_load_n(&m_local_replies, __ATOMIC_ACQUIRE) != expected) {
+        // The echo needs this core when there is only one
+        if (m_single_core)
+            sched_yield();
+    }
+    return 0;
+}
+
+static void bench_local() {
+    _sSocket_t server, client;
+    char name[32];
+
+    if (!selected("local_rtt"))
+        return;
+
+    m_single_core = (sysconf(_SC_NPROCESSORS_ONLN) <= 1);
+    snprintf(name, sizeof(name), "/socket-connector-bench-%d", (int)getpid());
+    TCPInit();
+    if (TCPConnectLocal(true, &server, name, tcp_echo_callback, NULL) != ERRCODE_NO_ERROR)
+        return;
+    if (TCPConnectLocal(false, &client, name, local_reply_callback, NULL) == ERRCODE_NO_ERROR) {
+        if (bench_round_trips("local_rtt", local_round_trip, &client))
+            fprintf(stderr, "local_rtt: echo failed\n");
+        TCPDisconnect(client);
+    }
+    TCPDisconnect(server);
+}
+
+static void tcp_connection_callback(_sSocket_t socket, bool connected) {
+    unsigned count = __atomic_load_n(&m_accepted_count, __ATOMIC_ACQUIRE);
+
+    if (connected && count < TCP_NUMBER_CLIENTS_TO_SERVER) {
+        m_accepted[count] = socket;
+        __atomic_store_n(&m_accepted_count, count + 1, __ATOMIC_RELEASE);
+    }
+}
+
+static int tcp_client(uint16_t port, bool nodelay) {
+    struct sockaddr_in server;
+    int one = 1;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (nodelay)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int wait_accepted(unsigned count) {
+    for (int i = 0; i < 2000; i++) {
+        if (__atomic_load_n(&m_accepted_count, __ATOMIC_ACQUIRE) >= count)
+            return 0;
+        usleep(1000);
+    }
+    return 1;
+}
+
+static void bench_lookup(void *ctx, uint64_t iterations) {
+    _sSocket_t socket = *(_sSocket_t *)ctx;
+    int connected = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+        connected += TCPIsConnected(socket);
+    m_sink = (float)connected;
+}
+
+static bool lookup_selected() {
+    char name[BENCH_NAME_SZ];
+
+    if (selected("tcp_lookup_miss"))
+        return true;
+    for (unsigned i = 0; i < sizeof(m_lookup_clients) / sizeof(m_lookup_clients[0]); i++) {
+        snprintf(name, sizeof(name), "tcp_lookup_clients_%u", m_lookup_clients[i]);
+        if (selected(name))
+            return true;
+    }
+    return false;
+}
+
+// Child process of one configuration: results go back through the pipe
+static int tcp_child(const struct bench_tcp_config *config, bool lookup, int out) {
+    sTcpProfile_t profile = {0};
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    _sSocket_t server;
+    unsigned first = m_result_count;
+    unsigned clients = 0;
+    int null_fd;
+    int fd;
+
+    // The TCP layer logs connections on stdout
+    null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0)
+        dup2(null_fd, STDOUT_FILENO);
+
+    profile.profile = config->profile;
+    profile.busyPollLoop = config->busy_loop;
+    profile.busyPollCpu = -1;
+    if (TCPInit() != ERRCODE_NO_ERROR || TCPSetEngine(config->engine) != ERRCODE_NO_ERROR ||
+        TCPSetProfile(&profile) != ERRCODE_NO_ERROR)
+        return 2;
+    if (TCPConnect(true, &server, NULL, 0, tcp_echo_callback, tcp_connection_callback) != ERRCODE_NO_ERROR)
+        return 1;
+    if (getsockname(server, (struct sockaddr *)&addr, &addr_len))
+        return 1;
+
+    fd = tcp_client(ntohs(addr.sin_port), config->profile == TCP_PROFILE_LOW_LATENCY);
+    if (fd < 0 || wait_accepted(++clients))
+        return 1;
+    if (selected(config->name) && bench_round_trips(config->name, round_trip, &fd))
+        return 1;
+
+    if (lookup) {
+        char name[BENCH_NAME_SZ];
+        _sSocket_t missing = 0x7FFFFFFF;
+
+        // The last client accepted is the last one the scan reaches
+        for (unsigned i = 0; i < sizeof(m_lookup_clients) / sizeof(m_lookup_clients[0]); i++) {
+            while (clients < m_lookup_clients[i]) {
+                if (tcp_client(ntohs(addr.sin_port), false) < 0 || wait_accepted(++clients))
+                    return 1;
+            }
+            snprintf(name, sizeof(name), "tcp_lookup_clients_%u", clients);
+            bench_run(name, bench_lookup, &m_accepted[clients - 1]);
+        }
+        bench_run("tcp_lookup_miss", bench_lookup, &missing);
+    }
+
+    for (unsigned i = first; i < m_result_count; i++) {
+        if (write(out, &m_results[i], sizeof(m_results[i])) != sizeof(m_results[i]))
+            return 1;
+    }
+    return 0;
+}
+
+static void bench_tcp() {
+    for (unsigned i = 0; i < sizeof(m_tcp_configs) / sizeof(m_tcp_configs[0]); i++) {
+        const struct bench_tcp_config *config = &m_tcp_configs[i];
+        bool lookup = config->lookup && lookup_selected();
+        struct bench_result res;
+        int status = 0;
+        int fds[2];
+        pid_t pid;
+
+        if (!selected(config->name) && !lookup)
+            continue;
+        if (pipe(fds))
+            return;
+
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            _exit(tcp_child(config, lookup, fds[1]));
+        }
+
+        close(fds[1]);
+        while (read(fds[0], &res, sizeof(res)) == sizeof(res)) {
+            if (m_result_count < BENCH_MAX_RESULTS)
+                m_results[m_result_count++] = res;
+        }
+        close(fds[0]);
+        waitpid(pid, &status, 0);
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 2)
+            fprintf(stderr, "%s: engine or profile unavailable, skipped\n", config->name);
+        else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fprintf(stderr, "%s: failed\n", config->name);
+    }
+}
+
+/******************************************************************************/
+// --check: the codec against sscanf and snprintf, on random input
+
+static uint32_t check_random(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static float check_float(uint32_t *state) {
+    uint32_t bits;
+    float value;
+
+    // Any finite float, or a short decimal like the clients send
+    do {
+        bits = check_random(state);
+        memcpy(&value, &bits, sizeof(value));
+    } while (!isfinite(value));
+    if (check_random(state) & 1)
+        value = (float)((int32_t)check_random(state) % 2000000) / 1000.0f;
+    return value;
+}
+
+// One number in the spellings a sender may use
+static int check_number(char *out, size_t size, uint32_t *state) {
+    static const char digits[] = "0123456789";
+    float value = check_float(state);
+    int n = 0;
+
+    switch (check_random(state) % 7) {
+    case 0:
+        return snprintf(out, size, "%f", value);
+    case 1:
+        return snprintf(out, size, "%.*f", (int)(check_random(state) % 10), value);
+    case 2:
+        return snprintf(out, size, "%.9g", value);
+    case 3:
+        return snprintf(out, size, "%e", value);
+    case 4:
+        return snprintf(out, size, "%.17g", (double)value * (1.0 + (check_random(state) % 1000) * 1e-12));
+    case 5:
+        return snprintf(out, size, "%d", (int)(check_random(state) % 100000) - 50000);
+    default:
+        // Digit runs of any length, around the point and the exponent
+        if (check_random(state) & 1)
+            out[n++] = (check_random(state) & 1) ? '-' : '+';
+        for (unsigned i = check_random(state) % 26; i > 0; i--)
+            out[n++] = digits[check_random(state) % 10];
+        if (check_random(state) & 1)
+            out[n++] = '.';
+        for (unsigned i = check_random(state) % 26; i > 0; i--)
+            out[n++] = digits[check_random(state) % 10];
+        if ((check_random(state) & 3) == 0) {
+            out[n++] = 'e';
+            if (check_random(state) & 1)
+                out[n++] = '-';
+            for (unsigned i = check_random(state) % 3; i > 0; i--)
+                out[n++] = digits[check_random(state) % 10];
+        }
+        out[n] = '\0';
+        return n;
+    }
+}
+
+// A body of count values, sometimes with spaces or trailing text
+static void check_body(char *out, size_t size, unsigned count, uint32_t *state) {
+    static const char *const tails[] = {"", "", "Gyro#2: 1-2-3", "e", "x", "-", " "};
+    size_t n = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (i != 0)
+            out[n++] = '-';
+        if ((check_random(state) & 7) == 0)
+            out[n++] = ' ';
+        n += (size_t)check_number(out + n, size - n - 32, state);
+    }
+    snprintf(out + n, size - n, "%s", tails[check_random(state) % 7]);
+}
+
+// Characters the grammar cares about, in any order
+static void check_garbage(char *out, uint32_t *state) {
+    static const char alphabet[] = "0123456789.-+eE \tinfaxp()";
+    unsigned n = check_random(state) % 32;
+
+    for (unsigned i = 0; i < n; i++)
+        out[i] = alphabet[check_random(state) % (sizeof(alphabet) - 1)];
+    out[n] = '\0';
+}
+
+static bool check_parse_case(const char *text, unsigned count, unsigned *reported) {
+    char reference[512];
+    float codec[4];
+    float libc[4];
+    int consumed = -1;
+    uint16_t n = codec_parse_floats(text, (uint16_t)strlen(text), codec, count);
+    int r;
+
+    // The codec stops before a nan payload: libc gets the text cut at the '('
+    snprintf(reference, sizeof(reference), "%.*s", (int)strcspn(text, "("), text);
+    r = (count == 3) ? sscanf(reference, " %f-%f-%f%n", &libc[0], &libc[1], &libc[2], &consumed)
+                     : sscanf(reference, " %f-%f-%f-%f%n", &libc[0], &libc[1], &libc[2], &libc[3], &consumed);
+
+    if (r != (int)count)
+        consumed = 0;
+    if (n == consumed && (n == 0 || memcmp(codec, libc, count * sizeof(float)) == 0))
+        return true;
+
+    if ((*reported)++ < BENCH_CHECK_REPORTED) {
+        printf("parse \"%s\": codec %u", text, n);
+        for (unsigned i = 0; n != 0 && i < count; i++)
+            printf(" %.9g", codec[i]);
+        printf(", libc %d", consumed);
+        for (unsigned i = 0; consumed != 0 && i < count; i++)
+            printf(" %.9g", libc[i]);
+        printf("\n");
+    }
+    return false;
+}
+
+static bool check_format_case(float value, unsigned decimals, unsigned *reported) {
+    char codec[CODEC_FLOAT_SZ];
+    char libc[CODEC_FLOAT_SZ];
+    int n = codec_format_fixed(codec, value, decimals);
+    int m = snprintf(libc, sizeof(libc), "%.*f", (int)decimals, (double)value);
+
+    if (n == m && strcmp(codec, libc) == 0)
+        return true;
+    if ((*reported)++ < BENCH_CHECK_REPORTED)
+        printf("format %a with %u decimals: codec \"%s\", libc \"%s\"\n", value, decimals, codec, libc);
+    return false;
+}
+
+static int run_check(unsigned cases) {
+    uint32_t state = 0x9E3779B9u;
+    unsigned parse_failed = 0, garbage_failed = 0, format_failed = 0;
+    unsigned reported = 0;
+    char text[512];
+
+    for (unsigned i = 0; i < cases; i++) {
+        unsigned count = 3 + (i & 1);
+
+        check_body(text, sizeof(text), count, &state);
+        parse_failed += !check_parse_case(text, count, &reported);
+        check_garbage(text, &state);
+        garbage_failed += !check_parse_case(text, count, &reported);
+    }
+
+    for (unsigned i = 0; i < cases; i++) {
+        unsigned decimals = check_random(&state) % (CODEC_MAX_DECIMALS + 1);
+        float value = check_float(&state);
+
+        // Exact ties as well: a few bits below the last decimal kept
+        if (i & 1)
+            value = (float)((int32_t)check_random(&state) % 100000) / (float)(1u << (check_random(&state) % 12));
+        format_failed += !check_format_case(value, decimals, &reported);
+    }
+
+    printf("parse: %u cases, %u differences\n", cases, parse_failed);
+    printf("parse garbage: %u cases, %u differences\n", cases, garbage_failed);
+    printf("format: %u cases, %u differences\n", cases, format_failed);
+    return (parse_failed + garbage_failed + format_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void print_table() {
+    for (unsigned i = 0; i < m_result_count; i++) {
+        const struct bench_result *res = &m_results[i];
+
+        printf("%-32s %12.1f ns/op %14.0f ops/s", res->name, res->ns_per_op, 1e9 / res->ns_per_op);
+        if (res->latency)
+            printf("   p50 %.0f  p99 %.0f  p99.9 %.0f  max %.0f ns",
+                   res->p50_ns, res->p99_ns, res->p999_ns, res->max_ns);
+        printf("\n");
+    }
+}
+
+static void print_json() {
+    printf("{\n  \"schema\": 1,\n");
+    printf("  \"build\": {\"compiler\": \"%s\", \"fusion_fixed_point\": %s, \"trace\": %s, \"uring\": %s},\n",
+           __VERSION__,
+#ifdef FUSION_FIXED_POINT
+           "true",
+#else
+           "false",
+#endif
+#ifdef TRACE_ENABLED
+           "true",
+#else
+           "false",
+#endif
+#ifdef TCP_HAVE_URING
+           "true"
+#else
+           "false"
+#endif
+           );
+    printf("  \"results\": [");
+    for (unsigned i = 0; i < m_result_count; i++) {
+        const struct bench_result *res = &m_results[i];
+
+        printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f",
+               (i == 0) ? "" : ",", res->name, (unsigned long long)res->iterations,
+               res->ns_per_op, 1e9 / res->ns_per_op);
+        if (res->latency)
+            printf(", \"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f",
+                   res->p50_ns, res->p99_ns, res->p999_ns, res->max_ns);
+        printf("}");
+    }
+    printf("\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    bool check = false;
+    unsigned check_cases = BENCH_CHECK_CASES;
+    uint32_t seed = 12345;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--quick") == 0) {
+            m_min_run_ns = BENCH_QUICK_RUN_MS * 1000000ull;
+            m_rtt_samples = BENCH_QUICK_RTT_SAMPLES;
+            check_cases = BENCH_QUICK_CHECK_CASES;
+        }
+        else if (strcmp(argv[i], "--check") == 0)
+            check = true;
+        else if (argv[i][0] == '-') {
+            printf("Usage: %s [--json] [--quick] [--check] [filter]\n"
+                   " --json\t\t: Results as JSON, same keys and order on every run\n"
+                   " --quick\t: Short runs, for a smoke check\n"
+                   " --check\t: Compare the text codec with libc on random input, no benchmarks\n"
+                   " filter\t\t: Only the benchmarks whose name contains it\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+            m_filter = argv[i];
+    }
+
+    // Raw counts spread over the full scale, the same on every run
+    for (int i = 0; i < 64; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            seed = seed * 1103515245u + 12345u;
+            m_raw[i][axis] = (int16_t)(seed >> 16);
+        }
+    }
+
+    if (check)
+        return run_check(check_cases);
+
+    bench_run("parse_accel", bench_parse_accel, NULL);
+    bench_run("parse_accel_codec", bench_parse_accel_codec, NULL);
+    bench_run("parse_quat", bench_parse_quat, NULL);
+    bench_run("parse_quat_codec", bench_parse_quat_codec, NULL);
+    bench_run("format_delta", bench_format_delta, NULL);
+    bench_run("format_delta_codec", bench_format_delta_codec, NULL);
+    bench_run("format_sample", bench_format_sample, NULL);
+
+    register_handlers(skip_handler, skip_handler);
+    bench_run("dispatch_token", bench_dispatch, (void *)m_single_message);
+    register_handlers(vector_handler, quat_handler);
+    bench_run("dispatch_parse", bench_dispatch, (void *)m_single_message);
+    bench_run("dispatch_parse_x4", bench_dispatch, (void *)m_batch_message);
+    register_handlers(vector_codec_handler, quat_codec_handler);
+    bench_run("dispatch_parse_codec", bench_dispatch, (void *)m_single_message);
+    bench_run("dispatch_parse_x4_codec", bench_dispatch, (void *)m_batch_message);
+
+    bench_run("convert_accel", bench_convert_accel, NULL);
+    bench_run("convert_gyro", bench_convert_gyro, NULL);
+
+    if (selected("rules_1") && load_rules(1) == 0)
+        bench_run("rules_1", bench_rules, NULL);
+    if (selected("rules_16") && load_rules(16) == 0)
+        bench_run("rules_16", bench_rules, NULL);
+
+    bench_socketpair();
+    bench_local();
+    bench_tcp();
+
+    if (json)
+        print_json();
+    else
+        print_table();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/**
+ ******************************************************************************
+ * @file    buffer_pool.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "buffer_pool.h"
+
+/******************************************************************************
+ * Defines
+ *****************************************************************************/
+// Numero de classes de tamanho: BUFFER_POOL_MIN_SZ, 2x, 4x ... BUFFER_POOL_MAX_SZ
+#define BUFFER_POOL_CLASSES			6
+
+/******************************************************************************/
+// Cabecalho de cada bloco, imediatamente antes do buffer entregue
+struct _sPoolBlock
+{
+	struct _sPoolBlock *next;
+	uint32_t u32Class;
+	uint32_t u32Pad;			// Mantem o buffer alinhado em 16 bytes
+};
+
+// Pool compartilhado: os slabs nunca voltam ao sistema, os blocos circulam
+struct _sSharedPool
+{
+	pthread_mutex_t lock;
+	struct _sPoolBlock *freeList[BUFFER_POOL_CLASSES];
+};
+
+// Cache de uma thread, sem lock
+struct _sBufferCache
+{
+	struct _sPoolBlock *freeList[BUFFER_POOL_CLASSES];
+	uint32_t u32Count[BUFFER_POOL_CLASSES];
+	bool bRegistered;
+};
+
+static struct _sSharedPool m_sShared = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static _Thread_local struct _sBufferCache m_sCache;
+static pthread_key_t m_cacheKey;
+static pthread_once_t m_cacheOnce = PTHREAD_ONCE_INIT;
+
+/*****************************************************************************/
+/**
+ * @brief Devolve ao pool compartilhado o cache da thread que esta terminando
+ *
+ * @param arg - Cache da thread
+ */
+static void _bufferPoolDestroy(void *arg)
+{
+	struct _sBufferCache *cache = (struct _sBufferCache*)arg;
+	struct _sPoolBlock *block;
+
+	pthread_mutex_lock(&m_sShared.lock);
+	for(uint32_t cls = 0; cls < BUFFER_POOL_CLASSES; cls++)
+	{
+		while(cache->freeList[cls] != NULL)
+		{
+			block = cache->freeList[cls];
+			cache->freeList[cls] = block->next;
+			block->next = m_sShared.freeList[cls];
+			m_sShared.freeList[cls] = block;
+		}
+		cache->u32Count[cls] = 0;
+	}
+	pthread_mutex_unlock(&m_sShared.lock);
+}
+//***************************************************************************
+static void _bufferPoolCreateKey(void)
+{
+	pthread_key_create(&m_cacheKey, _bufferPoolDestroy);
+}
+//***************************************************************************
+static uint32_t _bufferPoolClassSize(uint32_t cls)
+{
+	return (uint32_t)BUFFER_POOL_MIN_SZ << cls;
+}
+//***************************************************************************
+// Aloca um novo slab e o divide em blocos da classe (lock do pool compartilhado)
+static bool _bufferPoolRefill(uint32_t cls)
+{
+	uint8_t *slab;
+	struct _sPoolBlock *block;
+	uint8_t *cursor;
+	uint32_t stride;
+	uint32_t count;
+
+	slab = malloc(BUFFER_POOL_SLAB_SZ);
+	if(slab == NULL)
+		return false;
+
+	stride = sizeof(struct _sPoolBlock) + _bufferPoolClassSize(cls);
+	count = BUFFER_POOL_SLAB_SZ / stride;
+	cursor = slab;
+	while(count--)
+	{
+		block = (struct _sPoolBlock*)cursor;
+		block->u32Class = cls;
+		block->next = m_sShared.freeList[cls];
+		m_sShared.freeList[cls] = block;
+		cursor += stride;
+	}
+	return true;
+}
+
+/*****************************************************************************/
+uint8_t* bufferPoolGet(uint16_t size, uint16_t *capacity)
+{
+	struct _sPoolBlock *block;
+	uint32_t cls = 0;
+
+	if(size > BUFFER_POOL_MAX_SZ)
+		return NULL;
+
+	while(_bufferPoolClassSize(cls) < size)
+		cls++;
+
+	block = m_sCache.freeList[cls];
+	if(block != NULL)
+	{
+		m_sCache.freeList[cls] = block->next;
+		m_sCache.u32Count[cls]--;
+	}
+	else
+	{
+		pthread_mutex_lock(&m_sShared.lock);
+		if((m_sShared.freeList[cls] != NULL) || _bufferPoolRefill(cls))
+		{
+			block = m_sShared.freeList[cls];
+			m_sShared.freeList[cls] = block->next;
+		}
+		pthread_mutex_unlock(&m_sShared.lock);
+		if(block == NULL)
+			return NULL;
+	}
+
+	if(capacity != NULL)
+		*capacity = (uint16_t)_bufferPoolClassSize(cls);
+	return (uint8_t*)(block + 1);
+}
+//***************************************************************************
+void bufferPoolRelease(uint8_t *buffer)
+{
+	struct _sPoolBlock *block;
+	uint32_t cls;
+
+	if(buffer == NULL)
+		return;
+
+	block = ((struct _sPoolBlock*)buffer) - 1;
+	cls = block->u32Class;
+
+	if(!m_sCache.bRegistered)
+	{
+		pthread_once(&m_cacheOnce, _bufferPoolCreateKey);
+		pthread_setspecific(m_cacheKey, &m_sCache);
+		m_sCache.bRegistered = true;
+	}
+
+	// Emprestimo e devolucao a cada leitura: o caso comum fica no cache
+	if(m_sCache.u32Count[cls] < BUFFER_POOL_CACHE_BLOCKS)
+	{
+		block->next = m_sCache.freeList[cls];
+		m_sCache.freeList[cls] = block;
+		m_sCache.u32Count[cls]++;
+		return;
+	}
+
+	pthread_mutex_lock(&m_sShared.lock);
+	block->next = m_sShared.freeList[cls];
+	m_sShared.freeList[cls] = block;
+	pthread_mutex_unlock(&m_sShared.lock);
+}
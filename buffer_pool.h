@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * @file    buffer_pool.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef BUFFER_POOL_H_
+#define BUFFER_POOL_H_
+
+#include <stdint.h>
+
+// Menor classe de tamanho (as demais dobram ate a maior)
+#define BUFFER_POOL_MIN_SZ			64
+
+// Maior classe de tamanho
+#define BUFFER_POOL_MAX_SZ			2048
+
+// Tamanho de cada slab alocado para uma classe do pool compartilhado
+#define BUFFER_POOL_SLAB_SZ			(16 * 1024)
+
+// Blocos livres guardados por thread em cada classe
+#define BUFFER_POOL_CACHE_BLOCKS	1
+
+/*****************************************************************************/
+/**
+ * @brief Empresta um buffer. Os slabs ficam em um pool compartilhado por
+ * todas as threads, sob mutex; cada thread guarda sem lock ate
+ * BUFFER_POOL_CACHE_BLOCKS blocos livres por classe, devolvidos ao pool
+ * quando ela termina. Uma conexao ociosa retem no maximo esse cache.
+ *
+ * @param size - Tamanho minimo desejado (ate BUFFER_POOL_MAX_SZ)
+ * @param capacity - Ponteiro para retornar o tamanho real da classe (opcional)
+ * @return Ponteiro para o buffer ou NULL em caso de falha
+ */
+uint8_t* bufferPoolGet(uint16_t size, uint16_t *capacity);
+
+//***************************************************************************
+/**
+ * @brief Devolve um buffer: ao cache da thread corrente enquanto houver
+ * espaco, ao pool compartilhado depois.
+ *
+ * @param buffer - Buffer obtido por bufferPoolGet
+ */
+void bufferPoolRelease(uint8_t *buffer);
+
+#endif /* BUFFER_POOL_H_ */
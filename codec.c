@@ -0,0 +1,383 @@
+/**
+ ******************************************************************************
+ * @file    codec.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#define _GNU_SOURCE		// strtof_l, newlocale
+
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec.h"
+
+// Exact in a double: integers up to 2^53 and powers of ten up to 10^22
+#define CODEC_EXACT_MANTISSA    (1ull << 53)
+#define CODEC_EXACT_POW10       22
+
+// Significant digits kept for a number longer than CODEC_FLOAT_SZ: a float
+// midpoint has at most 112, so more than that rounds the same
+#define CODEC_LONG_DIGITS       120
+
+// Mantissa digits accumulated one by one, and eight at a time
+#define CODEC_MANTISSA_LIMIT    1000000000000000000ull     // 10^18
+#define CODEC_SWAR_LIMIT        100000000000ull            // 10^11
+
+// Eight digits per load needs little endian
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define CODEC_SWAR              1
+#else
+#define CODEC_SWAR              0
+#endif
+
+// With extended precision intermediates (x87) a double product is rounded twice
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+#define CODEC_FAST_PATH         1
+#else
+#define CODEC_FAST_PATH         0
+#endif
+
+static const double m_pow10[CODEC_EXACT_POW10 + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const char m_digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static locale_t m_c_locale;
+static pthread_once_t m_c_locale_once = PTHREAD_ONCE_INIT;
+
+static void codec_locale_init() {
+    m_c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+static inline bool codec_is_digit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+// isspace of the C locale: space, \t, \n, \v, \f, \r
+static inline bool codec_is_space(char c) {
+    return (c == ' ') || ((unsigned)(c - '\t') < 5);
+}
+
+#if CODEC_SWAR
+static inline bool codec_eight_digits(uint64_t chunk) {
+    return (((chunk + 0x4646464646464646ull) | (chunk - 0x3030303030303030ull)) & 0x8080808080808080ull) == 0;
+}
+
+// Value of eight ASCII digits, first digit in the lowest byte
+static inline uint32_t codec_eight_value(uint64_t chunk) {
+    chunk -= 0x3030303030303030ull;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+             (((chunk >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)chunk;
+}
+#endif
+
+// Append a run of digits to the mantissa; slow is set when some did not fit
+static const char *codec_digits(const char *p, const char *end, uint64_t *mantissa, bool *slow) {
+#if CODEC_SWAR
+    while ((end - p) >= 8 && *mantissa < CODEC_SWAR_LIMIT) {
+        uint64_t chunk;
+
+        memcpy(&chunk, p, sizeof(chunk));
+        if (!codec_eight_digits(chunk))
+            break;
+        *mantissa = (*mantissa * 100000000ull) + codec_eight_value(chunk);
+        p += 8;
+    }
+#endif
+    while (p < end && codec_is_digit(*p)) {
+        if (*mantissa < CODEC_MANTISSA_LIMIT)
+            *mantissa = (*mantissa * 10) + (uint64_t)(*p - '0');
+        else
+            *slow = true;
+        p++;
+    }
+    return p;
+}
+
+// The double is correctly rounded; rounding it to float again is only wrong
+// when it fell exactly on a midpoint between two floats
+static inline bool codec_single_rounding(double d) {
+    uint64_t bits;
+
+    if (!(d >= FLT_MIN && d < FLT_MAX))
+        return false;
+    memcpy(&bits, &d, sizeof(bits));
+    return (bits & 0x1FFFFFFFull) != 0x10000000ull;
+}
+
+// Word at p in any case, within end
+static bool codec_word(const char *p, const char *end, const char *word) {
+    for (; *word != '\0'; word++, p++) {
+        if (p == end || (*p | 0x20) != *word)
+            return false;
+    }
+    return true;
+}
+
+// strtof_l on a terminated copy of [start, end): the body may have no terminator within its length.
+// Input longer than CODEC_FLOAT_SZ - 1 is cut there
+static float codec_strtof(const char *start, const char *end, const char **stop) {
+    char text[CODEC_FLOAT_SZ];
+    size_t n = (size_t)(end - start);
+    char *last;
+    float value;
+
+    if (n > sizeof(text) - 1)
+        n = sizeof(text) - 1;
+    memcpy(text, start, n);
+    text[n] = '\0';
+
+    pthread_once(&m_c_locale_once, codec_locale_init);
+    value = strtof_l(text, &last, m_c_locale);
+    if (stop != NULL)
+        *stop = start + (last - text);
+    return value;
+}
+
+// A decimal number too long for the copy, already checked by the parser: its
+// first significant digits, a sticky 1 for any non-zero digit after them and
+// the decimal exponent, as "0.<digits>e<exponent>"
+static float codec_strtof_long(const char *p, const char *end, bool negative) {
+    char text[CODEC_LONG_DIGITS + 32];
+    int exponent = 0;
+    int power = 0;
+    unsigned kept = 0;
+    bool point = false;
+    bool sticky = false;
+    bool minus = false;
+    int n = 0;
+
+    if (*p == '-' || *p == '+')
+        p++;
+    if (negative)
+        text[n++] = '-';
+    text[n++] = '0';
+    text[n++] = '.';
+
+    for (; p < end && (codec_is_digit(*p) || *p == '.'); p++) {
+        if (*p == '.') {
+            point = true;
+        } else if (kept == 0 && *p == '0') {
+            exponent -= point;
+        } else {
+            if (kept < CODEC_LONG_DIGITS) {
+                text[n++] = *p;
+                kept++;
+            } else {
+                sticky = sticky || (*p != '0');
+            }
+            exponent += !point;
+        }
+    }
+    if (sticky)
+        text[n++] = '1';
+
+    if (p < end && (*p | 0x20) == 'e') {
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            minus = (*p == '-');
+            p++;
+        }
+        for (; p < end && codec_is_digit(*p); p++) {
+            if (power < 100000)
+                power = (power * 10) + (*p - '0');
+        }
+    }
+    exponent += minus ? -power : power;
+    snprintf(text + n, sizeof(text) - (size_t)n, "e%d", exponent);
+
+    pthread_once(&m_c_locale_once, codec_locale_init);
+    return strtof_l(text, NULL, m_c_locale);
+}
+
+// One value, as %f reads it; NULL when there is none
+static const char *codec_parse_float(const char *p, const char *end, float *value) {
+    const char *start = p;
+    const char *integer;
+    const char *fraction;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool negative = false;
+    bool slow = false;
+    bool digits;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    // No nan(...) payload: a sample never has one, and libc would read past end for it
+    if (p < end && (!codec_is_digit(*p) && *p != '.')) {
+        if (codec_word(p, end, "infinity")) {
+            *value = negative ? -INFINITY : INFINITY;
+            return p + 8;
+        }
+        if (codec_word(p, end, "inf")) {
+            *value = negative ? -INFINITY : INFINITY;
+            return p + 3;
+        }
+        if (codec_word(p, end, "nan")) {
+            *value = negative ? -NAN : NAN;
+            return p + 3;
+        }
+        return NULL;
+    }
+    // Hex is left to libc
+    if ((end - p) > 1 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        const char *stop;
+
+        // glibc takes "0x" and then fails when no hex digit follows
+        *value = codec_strtof(start, end, &stop);
+        return (stop > p + 1) ? stop : NULL;
+    }
+
+    integer = p;
+    p = codec_digits(p, end, &mantissa, &slow);
+    digits = (p != integer);
+    if (p < end && *p == '.') {
+        p++;
+        fraction = p;
+        p = codec_digits(p, end, &mantissa, &slow);
+        exponent = -(int)(p - fraction);
+        digits = digits || (p != fraction);
+    }
+    if (!digits)
+        return NULL;
+
+    // Like glibc, the exponent mark and its sign are taken even with no digits after them
+    if (p < end && (*p | 0x20) == 'e') {
+        bool minus = false;
+        int power = 0;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            minus = (*p == '-');
+            p++;
+        }
+        for (; p < end && codec_is_digit(*p); p++) {
+            if (power < 100000)
+                power = (power * 10) + (*p - '0');
+        }
+        exponent += minus ? -power : power;
+    }
+
+    if (mantissa == 0 && !slow) {
+        *value = negative ? -0.0f : 0.0f;
+        return p;
+    }
+#if CODEC_FAST_PATH
+    if (!slow && mantissa <= CODEC_EXACT_MANTISSA && exponent >= -CODEC_EXACT_POW10 &&
+        exponent <= CODEC_EXACT_POW10) {
+        double d = (exponent < 0) ? ((double)mantissa / m_pow10[-exponent])
+                                  : ((double)mantissa * m_pow10[exponent]);
+
+        if (codec_single_rounding(d)) {
+            *value = negative ? -(float)d : (float)d;
+            return p;
+        }
+    }
+#endif
+    // Long mantissas, subnormals, overflows and midpoints: the text is the same, so is the value
+    if (p - start < CODEC_FLOAT_SZ)
+        *value = codec_strtof(start, p, NULL);
+    else
+        *value = codec_strtof_long(start, p, negative);
+    return p;
+}
+
+uint16_t codec_parse_floats(const char *body, uint16_t len, float *value, unsigned count) {
+    const char *p = body;
+    const char *end = body + len;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (i != 0) {
+            if (p == end || *p != '-')
+                return 0;
+            p++;
+        }
+        while (p < end && codec_is_space(*p))
+            p++;
+        p = codec_parse_float(p, end, &value[i]);
+        if (p == NULL)
+            return 0;
+    }
+    return (uint16_t)(p - body);
+}
+
+static size_t codec_append(char *out, const char *text) {
+    size_t len = strlen(text);
+
+    memcpy(out, text, len);
+    return len;
+}
+
+size_t codec_format_delta(char *out, const char *tag, const float *delta) {
+    static const char *const labels[3] = {">: (x ", ", y ", ", z "};
+    size_t len = codec_append(out, "<Delta on ");
+
+    len += codec_append(out + len, tag);
+    for (int i = 0; i < 3; i++) {
+        len += codec_append(out + len, labels[i]);
+        len += (size_t)codec_format_fixed(out + len, delta[i], 2);
+    }
+    out[len++] = ')';
+    out[len] = '\0';
+    return len;
+}
+
+int codec_format_fixed(char *out, float value, unsigned decimals) {
+    char digits[24];
+    char *first = digits + sizeof(digits);
+    char *p = out;
+    double scaled;
+    uint64_t units;
+    unsigned count;
+
+    // A float has 24 significant bits and 10^8 needs 27: the scaled double is exact
+    scaled = (decimals <= CODEC_MAX_DECIMALS) ? fabs((double)value * m_pow10[decimals]) : INFINITY;
+    if (!(scaled < 1e19))
+        return snprintf(out, CODEC_FLOAT_SZ, "%.*f", (int)decimals, (double)value);
+
+    // Ties to even on the exact value, as printf rounds
+    units = (uint64_t)nearbyint(scaled);
+    while (units >= 100) {
+        first -= 2;
+        memcpy(first, &m_digit_pairs[(units % 100) * 2], 2);
+        units /= 100;
+    }
+    if (units >= 10) {
+        first -= 2;
+        memcpy(first, &m_digit_pairs[units * 2], 2);
+    } else {
+        *--first = (char)('0' + units);
+    }
+    count = (unsigned)(digits + sizeof(digits) - first);
+    for (; count < decimals + 1; count++)
+        *--first = '0';
+
+    if (signbit(value))
+        *p++ = '-';
+    memcpy(p, first, count - decimals);
+    p += count - decimals;
+    if (decimals != 0) {
+        *p++ = '.';
+        memcpy(p, first + count - decimals, decimals);
+        p += decimals;
+    }
+    *p = '\0';
+    return (int)(p - out);
+}
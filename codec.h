@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * @file    codec.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef CODEC_H_
+#define CODEC_H_
+#include <stddef.h>
+#include <stdint.h>
+
+// Most decimals codec_format_fixed writes itself; more go through snprintf
+#define CODEC_MAX_DECIMALS      8
+
+// Room for any codec_format_fixed output, terminator included
+#define CODEC_FLOAT_SZ          64
+
+/**
+ * @brief Parse count floats separated by '-', e.g. " 0.01-0.99--0.02", with
+ * the result of sscanf(body, " %f-%f-%f%n") for the same count: whitespace
+ * skipped before each value, the same values bit for bit and the same bytes
+ * consumed, except that nan stops before a "(...)" payload and hex input
+ * stops after CODEC_FLOAT_SZ - 1 characters. Decimal, inf and nan input is
+ * converted without libc; hex, very long mantissas and rounding corner
+ * cases go to strtof_l in the C locale, on a terminated copy of at most
+ * CODEC_FLOAT_SZ bytes. Nothing past len is read. No allocation and no
+ * dependency on the process locale.
+ *
+ * @param body: Text to parse, up to len bytes or a terminator
+ * @param len: Bytes available
+ * @param value: count values out
+ * @param count: Values to parse, up to 4
+ * @return Bytes consumed, 0 when fewer than count values could be parsed
+ */
+uint16_t codec_parse_floats(const char *body, uint16_t len, float *value, unsigned count);
+
+/**
+ * @brief Write a value with a fixed number of decimals and a terminator:
+ * the same text as printf("%.*f", decimals, value), rounding included.
+ *
+ * @param out: At least CODEC_FLOAT_SZ bytes
+ * @param value: Value to write
+ * @param decimals: Digits after the point
+ * @return Length written, without the terminator
+ */
+int codec_format_fixed(char *out, float value, unsigned decimals);
+
+/**
+ * @brief Write the reply to a delta message with a terminator: the same text
+ * as "<Delta on %s>: (x %.2f, y %.2f, z %.2f)", without the printf machinery.
+ *
+ * @param out: Room for the tag plus 3 * CODEC_FLOAT_SZ
+ * @param tag: Message token with its sensor tag, e.g. "Accel#2"
+ * @param delta: x, y and z
+ * @return Length written, without the terminator
+ */
+size_t codec_format_delta(char *out, const char *tag, const float *delta);
+
+#endif /* CODEC_H_ */
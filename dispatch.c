@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file    dispatch.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#define _GNU_SOURCE		// memrchr
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dispatch.h"
+
+struct dispatch_entry {
+	char token[DISPATCH_MAX_TOKEN_SZ + 1];
+	uint8_t token_len;
+	DispatchHandler_t handler;
+};
+
+// Connection that ends its messages
+struct dispatch_stream {
+	int id;
+	bool used;
+	bool overflow;				// Partial message too long: skipped up to its end
+	uint16_t len;
+	char partial[DISPATCH_PARTIAL_SZ + 1];
+};
+
+static struct dispatch_entry m_table[DISPATCH_TABLE_SZ];
+static uint32_t m_unknown_count = 0;
+
+// Slots are taken and released under the lock; the partial message belongs to the reading thread
+static struct dispatch_stream m_streams[DISPATCH_MAX_STREAMS];
+static uint32_t m_stream_count = 0;
+static pthread_mutex_t m_streams_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t dispatch_hash(const char *token, uint32_t len) {
+	return (((uint8_t)token[0] * 31u) + (uint8_t)token[len - 1] + (len * 7u)) & (DISPATCH_TABLE_SZ - 1);
+}
+
+void dispatch_init() {
+	memset(m_table, 0, sizeof(m_table));
+	m_unknown_count = 0;
+}
+
+int dispatch_register(const char *token, DispatchHandler_t handler) {
+	size_t len = strlen(token);
+	struct dispatch_entry *entry;
+
+	if (len == 0 || len > DISPATCH_MAX_TOKEN_SZ || handler == NULL)
+		return 1;
+
+	entry = &m_table[dispatch_hash(token, len)];
+	if (entry->handler != NULL && (entry->token_len != len || memcmp(entry->token, token, len) != 0)) {
+		// Pick another token (or tweak the hash): the slot must stay unique
+		return 1;
+	}
+
+	memcpy(entry->token, token, len);
+	entry->token[len] = 0;
+	entry->token_len = (uint8_t)len;
+	entry->handler = handler;
+	return 0;
+}
+
+int dispatch_message(const uint8_t *buffer, uint16_t len) {
+	const char *cursor = (const char *)buffer;
+	const char *end = cursor + len;
+	int handled = 0;
+
+	while (cursor < end && *cursor == DISPATCH_MESSAGE_END)
+		cursor++;
+	while (cursor < end) {
+		const char *limit = (end - cursor > DISPATCH_MAX_TOKEN_SZ) ? cursor + DISPATCH_MAX_TOKEN_SZ : end;
+		const char *sep = cursor;
+		const char *tag = NULL;
+		const struct dispatch_entry *entry;
+		uint32_t token_len;
+		uint32_t sensor_id = 0;
+		uint16_t consumed;
+
+		while (sep < limit && *sep != DISPATCH_TOKEN_SEPARATOR) {
+			if (*sep == DISPATCH_SENSOR_TAG)
+				tag = sep;
+			sep++;
+		}
+		if (sep == limit)
+			goto unknown;
+
+		if (tag != NULL) {
+			for (const char *digit = tag + 1; digit < sep; digit++) {
+				if (*digit < '0' || *digit > '9')
+					goto unknown;
+				sensor_id = (sensor_id * 10) + (uint32_t)(*digit - '0');
+				if (sensor_id > UINT8_MAX)
+					goto unknown;
+			}
+			if (tag + 1 == sep)
+				goto unknown;
+		}
+		token_len = (uint32_t)(((tag != NULL) ? tag : sep) - cursor);
+		if (token_len == 0)
+			goto unknown;
+
+		entry = &m_table[dispatch_hash(cursor, token_len)];
+		if (entry->handler == NULL || entry->token_len != token_len ||
+			memcmp(entry->token, cursor, token_len) != 0)
+			goto unknown;
+
+		sep++;
+		consumed = entry->handler((uint8_t)sensor_id, sep, (uint16_t)(end - sep));
+		if (consumed == 0)
+			break;
+		handled++;
+		cursor = sep + consumed;
+		while (cursor < end && *cursor == DISPATCH_MESSAGE_END)
+			cursor++;
+	}
+	return handled;
+
+unknown:
+	// The body length of an unknown type is unknown too: drop the rest
+	__atomic_fetch_add(&m_unknown_count, 1, __ATOMIC_RELAXED);
+	return handled;
+}
+
+static struct dispatch_stream *dispatch_find_stream(int stream, bool create) {
+	struct dispatch_stream *found = NULL;
+
+	pthread_mutex_lock(&m_streams_lock);
+	for (int i = 0; i < DISPATCH_MAX_STREAMS && found == NULL; i++) {
+		if (m_streams[i].used && m_streams[i].id == stream)
+			found = &m_streams[i];
+	}
+	for (int i = 0; i < DISPATCH_MAX_STREAMS && found == NULL && create; i++) {
+		if (!m_streams[i].used) {
+			found = &m_streams[i];
+			found->id = stream;
+			found->used = true;
+			found->overflow = false;
+			found->len = 0;
+			__atomic_add_fetch(&m_stream_count, 1, __ATOMIC_RELEASE);
+		}
+	}
+	pthread_mutex_unlock(&m_streams_lock);
+	return found;
+}
+
+// Append to the partial message; a message too long is counted once and skipped
+static void dispatch_keep(struct dispatch_stream *entry, const char *data, size_t len) {
+	if (entry->overflow)
+		return;
+	if (entry->len + len > DISPATCH_PARTIAL_SZ) {
+		__atomic_fetch_add(&m_unknown_count, 1, __ATOMIC_RELAXED);
+		entry->overflow = true;
+		entry->len = 0;
+		return;
+	}
+	memcpy(entry->partial + entry->len, data, len);
+	entry->len += (uint16_t)len;
+	entry->partial[entry->len] = 0;
+}
+
+int dispatch_stream(int stream, const uint8_t *buffer, uint16_t len) {
+	const char *data = (const char *)buffer;
+	const char *end = data + len;
+	const char *last = memrchr(data, DISPATCH_MESSAGE_END, len);
+	struct dispatch_stream *entry = NULL;
+	int handled = 0;
+
+	if (__atomic_load_n(&m_stream_count, __ATOMIC_ACQUIRE) != 0)
+		entry = dispatch_find_stream(stream, false);
+	if (entry == NULL && (last == NULL || (entry = dispatch_find_stream(stream, true)) == NULL))
+		return dispatch_message(buffer, len);
+
+	if (last == NULL) {
+		// Still inside one message
+		dispatch_keep(entry, data, len);
+		return 0;
+	}
+
+	// The message cut by the previous read ends at the first end of message
+	if (entry->len != 0 || entry->overflow) {
+		const char *first = memchr(data, DISPATCH_MESSAGE_END, len);
+
+		dispatch_keep(entry, data, (size_t)(first + 1 - data));
+		if (!entry->overflow)
+			handled += dispatch_message((const uint8_t *)entry->partial, entry->len);
+		entry->overflow = false;
+		entry->len = 0;
+		data = first + 1;
+	}
+
+	handled += dispatch_message((const uint8_t *)data, (uint16_t)(last + 1 - data));
+	dispatch_keep(entry, last + 1, (size_t)(end - (last + 1)));
+	return handled;
+}
+
+void dispatch_stream_close(int stream) {
+	struct dispatch_stream *entry = dispatch_find_stream(stream, false);
+
+	if (entry == NULL)
+		return;
+	pthread_mutex_lock(&m_streams_lock);
+	entry->used = false;
+	entry->len = 0;
+	__atomic_sub_fetch(&m_stream_count, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&m_streams_lock);
+}
+
+uint32_t dispatch_get_unknown_count() {
+	return __atomic_load_n(&m_unknown_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * @file    dispatch.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include <stdint.h>
+
+// Slots of the dispatch table (power of 2)
+#define DISPATCH_TABLE_SZ			64
+
+// Longest header token accepted, e.g. "Accel"
+#define DISPATCH_MAX_TOKEN_SZ		15
+
+// Separator between the header token and the body
+#define DISPATCH_TOKEN_SEPARATOR	':'
+
+// Optional sensor tag at the end of the token, e.g. "Accel#3"; untagged is sensor 0
+#define DISPATCH_SENSOR_TAG			'#'
+
+// Optional end of message; a connection that sends it gets messages cut
+// between two reads put back together
+#define DISPATCH_MESSAGE_END		'\n'
+
+// Connections with a partial message kept at the same time
+#define DISPATCH_MAX_STREAMS		16
+
+// Longest partial message kept; a longer one is dropped as unknown
+#define DISPATCH_PARTIAL_SZ			256
+
+/**
+ * @brief Message handler
+ * @param sensor_id: Sensor tag of the message
+ * @param body: Message content right after the separator
+ * @param len: Bytes available from body up to the end of the received buffer
+ * @return Bytes of body consumed by the message, 0 when it could not be parsed
+ */
+typedef uint16_t (*DispatchHandler_t) (uint8_t sensor_id, const char *body, uint16_t len);
+
+/**
+ * @brief Clear the handler table and the counters
+ */
+void dispatch_init();
+
+/**
+ * @brief Register the handler for a header token. The token is hashed with
+ * its first and last characters and its length; registration fails when two
+ * tokens land on the same slot, so lookups never probe.
+ *
+ * @param token: Header token, without the separator and the sensor tag
+ * @param handler: Handler for the messages of this type
+ * @return 0 on success, 1 on invalid token or collision
+ */
+int dispatch_register(const char *token, DispatchHandler_t handler);
+
+/**
+ * @brief Resolve and handle every message in the buffer. Messages coalesced
+ * by the stream are handled one after another.
+ *
+ * @param buffer: Received data
+ * @param len: Size of the received data
+ * @return Number of messages handled
+ */
+int dispatch_message(const uint8_t *buffer, uint16_t len);
+
+/**
+ * @brief Handle a read of a connection. Until the connection sends a
+ * DISPATCH_MESSAGE_END this is dispatch_message; from then on the text after
+ * the last end of message is kept and completed by the next reads. Reads of
+ * one connection must come from one thread at a time.
+ *
+ * @param stream: Connection id, e.g. the socket
+ * @param buffer: Received data
+ * @param len: Size of the received data
+ * @return Number of messages handled
+ */
+int dispatch_stream(int stream, const uint8_t *buffer, uint16_t len);
+
+/**
+ * @brief Forget the partial message of a connection, when it closes
+ */
+void dispatch_stream_close(int stream);
+
+/**
+ * @brief Number of messages whose header token has no handler
+ */
+uint32_t dispatch_get_unknown_count();
+
+#endif /* DISPATCH_H_ */
@@ -0,0 +1,332 @@
+/**
+ ******************************************************************************
+ * @file    fusion.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "fusion.h"
+
+#define FUSION_PI                   3.14159265358979f
+
+// Default gains
+#define FUSION_COMPLEMENTARY_ALPHA  0.98f
+#define FUSION_MADGWICK_BETA        0.1f
+#define FUSION_MAHONY_TWO_KP        1.0f
+
+// The arithmetic below is written once and expands to float or Q7.24
+#ifdef FUSION_FIXED_POINT
+#define FX_FRAC         24
+#define R(f)            ((fusion_real_t)((f) * (float)(1L << FX_FRAC)))
+#define R_MUL(a, b)     ((fusion_real_t)(((int64_t)(a) * (b)) >> FX_FRAC))
+#define R_DIV(a, b)     ((fusion_real_t)(((int64_t)(a) * (1L << FX_FRAC)) / (b)))
+#define R_TO_FLOAT(a)   ((float)(a) / (float)(1L << FX_FRAC))
+#define R_ABS(a)        ((a) < 0 ? -(a) : (a))
+#else
+#define R(f)            ((fusion_real_t)(f))
+#define R_MUL(a, b)     ((a) * (b))
+#define R_DIV(a, b)     ((a) / (b))
+#define R_TO_FLOAT(a)   (a)
+#define R_ABS(a)        fabsf(a)
+#endif
+
+// Accel counts to full-scale units; only the direction of gravity is used
+#define FUSION_ACCEL_SCALE          R(1.0f / 32768.0f)
+
+#ifdef FUSION_FIXED_POINT
+static fusion_real_t r_inv_sqrt(fusion_real_t x) {
+    fusion_real_t v, y;
+    int p, d;
+
+    if (x <= 0)
+        return 0;
+
+    // Bring x into [0.25, 1) with an even shift: 1/sqrt(x) = 1/sqrt(v) * 2^(-d/2)
+    p = 31 - __builtin_clz((uint32_t)x);
+    d = p - (FX_FRAC - 2);
+    if (d & 1)
+        d -= 1;
+    v = (d >= 0) ? (x >> d) : (x * (1 << -d));
+
+    // Linear first guess, then Newton steps
+    y = R(2.2f) - R_MUL(R(1.2f), v);
+    for (int i = 0; i < 4; i++)
+        y = R_MUL(y, R(1.5f) - R_MUL(R(0.5f), R_MUL(v, R_MUL(y, y))));
+
+    if (d >= 0)
+        return y >> (d / 2);
+    if (-d / 2 > 5)
+        return INT32_MAX;
+    return y * (1 << (-d / 2));
+}
+
+// atan(z) for |z| <= 1, max error about 0.0015 rad
+static fusion_real_t r_atan_unit(fusion_real_t z) {
+    fusion_real_t az = R_ABS(z);
+
+    return R_MUL(R(FUSION_PI / 4), z) -
+           R_MUL(R_MUL(z, az - R(1.0f)), R(0.2447f) + R_MUL(R(0.0663f), az));
+}
+
+static fusion_real_t r_atan2(fusion_real_t y, fusion_real_t x) {
+    fusion_real_t a;
+
+    if (x == 0 && y == 0)
+        return 0;
+
+    if (R_ABS(y) <= R_ABS(x)) {
+        a = r_atan_unit(R_DIV(y, x));
+        if (x < 0)
+            a += (y >= 0) ? R(FUSION_PI) : -R(FUSION_PI);
+        return a;
+    }
+    return ((y > 0) ? R(FUSION_PI / 2) : -R(FUSION_PI / 2)) - r_atan_unit(R_DIV(x, y));
+}
+#else
+static fusion_real_t r_inv_sqrt(fusion_real_t x) {
+    return (x > 0) ? 1.0f / sqrtf(x) : 0;
+}
+
+static fusion_real_t r_atan2(fusion_real_t y, fusion_real_t x) {
+    return atan2f(y, x);
+}
+#endif
+
+static fusion_real_t r_sqrt(fusion_real_t x) {
+    return (x > 0) ? R_MUL(x, r_inv_sqrt(x)) : 0;
+}
+
+// Scale v to unit length; returns 1 when v is the zero vector
+static int r_normalize(fusion_real_t *v, int n) {
+    fusion_real_t norm2 = 0;
+    fusion_real_t inv;
+    int i;
+
+#ifdef FUSION_FIXED_POINT
+    // Normalizing is scale invariant: keep the peak in [1, 4) so the sum of
+    // squares neither overflows nor loses its low bits
+    fusion_real_t peak = 0;
+    for (i = 0; i < n; i++) {
+        if (R_ABS(v[i]) > peak)
+            peak = R_ABS(v[i]);
+    }
+    if (peak == 0)
+        return 1;
+    while (peak >= R(4.0f)) {
+        for (i = 0; i < n; i++)
+            v[i] >>= 1;
+        peak >>= 1;
+    }
+    while (peak < R(1.0f)) {
+        for (i = 0; i < n; i++)
+            v[i] *= 2;
+        peak *= 2;
+    }
+#endif
+
+    for (i = 0; i < n; i++)
+        norm2 += R_MUL(v[i], v[i]);
+    if (norm2 == 0)
+        return 1;
+
+    inv = r_inv_sqrt(norm2);
+    for (i = 0; i < n; i++)
+        v[i] = R_MUL(v[i], inv);
+    return 0;
+}
+
+static void complementary_update(struct fusion_state *state, fusion_real_t a[3], const fusion_real_t g[3]) {
+    fusion_real_t *angles = state->angles;
+    fusion_real_t alpha = state->gain;
+    fusion_real_t roll, pitch;
+
+    angles[0] += R_MUL(g[0], state->dt);
+    angles[1] += R_MUL(g[1], state->dt);
+    angles[2] += R_MUL(g[2], state->dt);
+
+    // Tilt from gravity corrects the gyro drift on roll and pitch
+    if (a[0] != 0 || a[1] != 0 || a[2] != 0) {
+        roll = r_atan2(a[1], a[2]);
+        pitch = r_atan2(-a[0], r_sqrt(R_MUL(a[1], a[1]) + R_MUL(a[2], a[2])));
+        angles[0] = R_MUL(alpha, angles[0]) + R_MUL(R(1.0f) - alpha, roll);
+        angles[1] = R_MUL(alpha, angles[1]) + R_MUL(R(1.0f) - alpha, pitch);
+    }
+
+    if (angles[2] > R(FUSION_PI))
+        angles[2] -= R(2 * FUSION_PI);
+    else if (angles[2] < -R(FUSION_PI))
+        angles[2] += R(2 * FUSION_PI);
+}
+
+static void madgwick_update(struct fusion_state *state, fusion_real_t a[3], const fusion_real_t g[3]) {
+    fusion_real_t *q = state->q;
+    fusion_real_t qdot[4], s[4];
+    fusion_real_t _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2, _8q1, _8q2;
+    fusion_real_t q0q0, q1q1, q2q2, q3q3;
+    int i;
+
+    // Rate of change of the quaternion from the gyro
+    qdot[0] = R_MUL(R(0.5f), -R_MUL(q[1], g[0]) - R_MUL(q[2], g[1]) - R_MUL(q[3], g[2]));
+    qdot[1] = R_MUL(R(0.5f), R_MUL(q[0], g[0]) + R_MUL(q[2], g[2]) - R_MUL(q[3], g[1]));
+    qdot[2] = R_MUL(R(0.5f), R_MUL(q[0], g[1]) - R_MUL(q[1], g[2]) + R_MUL(q[3], g[0]));
+    qdot[3] = R_MUL(R(0.5f), R_MUL(q[0], g[2]) + R_MUL(q[1], g[1]) - R_MUL(q[2], g[0]));
+
+    // Gradient descent step towards the measured gravity
+    if (r_normalize(a, 3) == 0) {
+        _2q0 = 2 * q[0];
+        _2q1 = 2 * q[1];
+        _2q2 = 2 * q[2];
+        _2q3 = 2 * q[3];
+        _4q0 = 4 * q[0];
+        _4q1 = 4 * q[1];
+        _4q2 = 4 * q[2];
+        _8q1 = 8 * q[1];
+        _8q2 = 8 * q[2];
+        q0q0 = R_MUL(q[0], q[0]);
+        q1q1 = R_MUL(q[1], q[1]);
+        q2q2 = R_MUL(q[2], q[2]);
+        q3q3 = R_MUL(q[3], q[3]);
+
+        s[0] = R_MUL(_4q0, q2q2) + R_MUL(_2q2, a[0]) + R_MUL(_4q0, q1q1) - R_MUL(_2q1, a[1]);
+        s[1] = R_MUL(_4q1, q3q3) - R_MUL(_2q3, a[0]) + 4 * R_MUL(q0q0, q[1]) - R_MUL(_2q0, a[1]) - _4q1 +
+               R_MUL(_8q1, q1q1) + R_MUL(_8q1, q2q2) + R_MUL(_4q1, a[2]);
+        s[2] = 4 * R_MUL(q0q0, q[2]) + R_MUL(_2q0, a[0]) + R_MUL(_4q2, q3q3) - R_MUL(_2q3, a[1]) - _4q2 +
+               R_MUL(_8q2, q1q1) + R_MUL(_8q2, q2q2) + R_MUL(_4q2, a[2]);
+        s[3] = 4 * R_MUL(q1q1, q[3]) - R_MUL(_2q1, a[0]) + 4 * R_MUL(q2q2, q[3]) - R_MUL(_2q2, a[1]);
+
+        if (r_normalize(s, 4) == 0) {
+            for (i = 0; i < 4; i++)
+                qdot[i] -= R_MUL(state->gain, s[i]);
+        }
+    }
+
+    for (i = 0; i < 4; i++)
+        q[i] += R_MUL(qdot[i], state->dt);
+    r_normalize(q, 4);
+}
+
+static void mahony_update(struct fusion_state *state, fusion_real_t a[3], fusion_real_t g[3]) {
+    fusion_real_t *q = state->q;
+    fusion_real_t halfvx, halfvy, halfvz;
+    fusion_real_t halfex, halfey, halfez;
+    fusion_real_t half_dt, qa, qb, qc;
+
+    // Proportional feedback from the error between estimated and measured gravity
+    if (r_normalize(a, 3) == 0) {
+        halfvx = R_MUL(q[1], q[3]) - R_MUL(q[0], q[2]);
+        halfvy = R_MUL(q[0], q[1]) + R_MUL(q[2], q[3]);
+        halfvz = R_MUL(q[0], q[0]) - R(0.5f) + R_MUL(q[3], q[3]);
+
+        halfex = R_MUL(a[1], halfvz) - R_MUL(a[2], halfvy);
+        halfey = R_MUL(a[2], halfvx) - R_MUL(a[0], halfvz);
+        halfez = R_MUL(a[0], halfvy) - R_MUL(a[1], halfvx);
+
+        g[0] += R_MUL(state->gain, halfex);
+        g[1] += R_MUL(state->gain, halfey);
+        g[2] += R_MUL(state->gain, halfez);
+    }
+
+    half_dt = R_MUL(R(0.5f), state->dt);
+    g[0] = R_MUL(g[0], half_dt);
+    g[1] = R_MUL(g[1], half_dt);
+    g[2] = R_MUL(g[2], half_dt);
+
+    qa = q[0];
+    qb = q[1];
+    qc = q[2];
+    q[0] += -R_MUL(qb, g[0]) - R_MUL(qc, g[1]) - R_MUL(q[3], g[2]);
+    q[1] += R_MUL(qa, g[0]) + R_MUL(qc, g[2]) - R_MUL(q[3], g[1]);
+    q[2] += R_MUL(qa, g[1]) - R_MUL(qb, g[2]) + R_MUL(q[3], g[0]);
+    q[3] += R_MUL(qa, g[2]) + R_MUL(qb, g[1]) - R_MUL(qc, g[0]);
+    r_normalize(q, 4);
+}
+
+int fusion_init(struct fusion_state *state, int filter, float sample_rate_hz, float gyro_lsb_per_dps) {
+    if (filter < FUSION_NONE || filter > FUSION_MAHONY || sample_rate_hz <= 0 || gyro_lsb_per_dps <= 0)
+        return 1;
+
+    memset(state, 0, sizeof(*state));
+    state->filter = filter;
+    state->dt = R(1.0f / sample_rate_hz);
+    state->gyro_scale = R((FUSION_PI / 180.0f) / gyro_lsb_per_dps);
+    state->q[0] = R(1.0f);
+
+    switch (filter) {
+    case FUSION_COMPLEMENTARY:
+        state->gain = R(FUSION_COMPLEMENTARY_ALPHA);
+        break;
+    case FUSION_MADGWICK:
+        state->gain = R(FUSION_MADGWICK_BETA);
+        break;
+    case FUSION_MAHONY:
+        state->gain = R(FUSION_MAHONY_TWO_KP);
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+void fusion_update(struct fusion_state *state, const int16_t accel[3], const int16_t gyro[3]) {
+    fusion_real_t a[3], g[3];
+
+    for (int i = 0; i < 3; i++) {
+        a[i] = (fusion_real_t)accel[i] * FUSION_ACCEL_SCALE;
+        g[i] = (fusion_real_t)gyro[i] * state->gyro_scale;
+    }
+
+    switch (state->filter) {
+    case FUSION_COMPLEMENTARY:
+        complementary_update(state, a, g);
+        break;
+    case FUSION_MADGWICK:
+        madgwick_update(state, a, g);
+        break;
+    case FUSION_MAHONY:
+        mahony_update(state, a, g);
+        break;
+    default:
+        break;
+    }
+}
+
+void fusion_get_quaternion(const struct fusion_state *state, float q[4]) {
+    if (state->filter == FUSION_COMPLEMENTARY) {
+        float cr = cosf(R_TO_FLOAT(state->angles[0]) / 2), sr = sinf(R_TO_FLOAT(state->angles[0]) / 2);
+        float cp = cosf(R_TO_FLOAT(state->angles[1]) / 2), sp = sinf(R_TO_FLOAT(state->angles[1]) / 2);
+        float cy = cosf(R_TO_FLOAT(state->angles[2]) / 2), sy = sinf(R_TO_FLOAT(state->angles[2]) / 2);
+
+        q[0] = cr * cp * cy + sr * sp * sy;
+        q[1] = sr * cp * cy - cr * sp * sy;
+        q[2] = cr * sp * cy + sr * cp * sy;
+        q[3] = cr * cp * sy - sr * sp * cy;
+        return;
+    }
+
+    for (int i = 0; i < 4; i++)
+        q[i] = R_TO_FLOAT(state->q[i]);
+}
+
+void fusion_get_euler(const struct fusion_state *state, float euler[3]) {
+    float q[4];
+    float sinp;
+
+    if (state->filter == FUSION_COMPLEMENTARY) {
+        for (int i = 0; i < 3; i++)
+            euler[i] = R_TO_FLOAT(state->angles[i]) * (180.0f / FUSION_PI);
+        return;
+    }
+
+    fusion_get_quaternion(state, q);
+    sinp = 2 * (q[0] * q[2] - q[3] * q[1]);
+    if (sinp > 1)
+        sinp = 1;
+    else if (sinp < -1)
+        sinp = -1;
+    euler[0] = atan2f(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])) * (180.0f / FUSION_PI);
+    euler[1] = asinf(sinp) * (180.0f / FUSION_PI);
+    euler[2] = atan2f(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3])) * (180.0f / FUSION_PI);
+}
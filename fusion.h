@@ -0,0 +1,61 @@
+/**
+ ******************************************************************************
+ * @file    fusion.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef FUSION_H_
+#define FUSION_H_
+#include <stdint.h>
+
+// Build with FUSION_FIXED_POINT for boards without a fast FPU: the per-sample
+// update then runs in Q7.24 integers, only the output conversion uses floats.
+#ifdef FUSION_FIXED_POINT
+typedef int32_t fusion_real_t;
+#else
+typedef float fusion_real_t;
+#endif
+
+enum fusion_filter {
+    FUSION_NONE,
+    FUSION_COMPLEMENTARY,
+    FUSION_MADGWICK,
+    FUSION_MAHONY,
+};
+
+struct fusion_state {
+    int filter;
+    fusion_real_t dt;               // Sample period (s)
+    fusion_real_t gyro_scale;       // rad/s per gyro count
+    fusion_real_t gain;             // alpha, beta or 2*Kp, depending on the filter
+    fusion_real_t q[4];             // Orientation (w, x, y, z), Madgwick/Mahony
+    fusion_real_t angles[3];        // Roll, pitch, yaw (rad), complementary
+};
+
+/**
+ * @brief Reset the orientation and select the filter
+ * @param state: Filter state
+ * @param filter: One of enum fusion_filter
+ * @param sample_rate_hz: Rate at which fusion_update is called
+ * @param gyro_lsb_per_dps: Gyro sensitivity (counts per degree/s)
+ * @return 0 on success, 1 on invalid parameters
+ */
+int fusion_init(struct fusion_state *state, int filter, float sample_rate_hz, float gyro_lsb_per_dps);
+
+/**
+ * @brief Feed one sample of raw counts (as read by mpu6050_get_motion)
+ */
+void fusion_update(struct fusion_state *state, const int16_t accel[3], const int16_t gyro[3]);
+
+/**
+ * @brief Current orientation as a unit quaternion (w, x, y, z)
+ */
+void fusion_get_quaternion(const struct fusion_state *state, float q[4]);
+
+/**
+ * @brief Current orientation as roll, pitch and yaw in degrees
+ */
+void fusion_get_euler(const struct fusion_state *state, float euler[3]);
+
+#endif /* FUSION_H_ */
@@ -0,0 +1,398 @@
+/**
+ ******************************************************************************
+ * @file    history.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#define _GNU_SOURCE		// memrchr
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "dispatch.h"
+#include "shm_cache.h"
+#include "thread_wrapper.h"
+
+// Longest formatted sample
+#define HISTORY_LINE_SZ     128
+
+struct history_stream {
+    pthread_mutex_t lock;
+    uint64_t head;                  // Samples ever appended; slot is head & (capacity - 1)
+    struct history_sample samples[HISTORY_CAPACITY];
+};
+
+// Sample of a replay backlog, copied under the stream lock and formatted by the worker
+struct history_entry {
+    struct history_sample sample;
+    uint8_t sensor_id;
+    uint8_t channel;
+};
+
+enum history_state {
+    HISTORY_FREE,
+    HISTORY_JOINING,                // Backlog being sent, live samples queued behind it
+    HISTORY_LIVE,                   // Live samples queued as they arrive
+    HISTORY_CLOSING,                // Dropped; the worker releases it
+};
+
+struct history_subscriber {
+    _sSocket_t socket;
+    int state;
+    // First sample of each stream not in the backlog, atomic: set under the stream lock
+    uint64_t cut[SHM_CACHE_MAX_SENSORS][SHM_CACHE_CHANNELS];
+    // Backlog, only touched by the worker once it runs
+    struct history_entry *backlog;
+    uint32_t backlog_count;
+    uint32_t backlog_next;
+    bool truncated;
+    char *pending;
+    size_t len;
+    size_t cap;
+    size_t sent;
+    pthread_cond_t wake;            // Text queued or closing
+    sThread_t worker;
+};
+
+static struct history_stream *m_streams[SHM_CACHE_MAX_SENSORS][SHM_CACHE_CHANNELS];
+static pthread_mutex_t m_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Serializes fan out and subscriber changes; appends skip it while nobody listens
+static pthread_mutex_t m_fanout_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct history_subscriber m_subscribers[HISTORY_MAX_SUBSCRIBERS];
+static uint32_t m_subscriber_count = 0;
+
+static struct timespec m_epoch;
+
+static uint32_t history_now_ms() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((int64_t)(ts.tv_sec - m_epoch.tv_sec) * 1000) +
+                      ((ts.tv_nsec - m_epoch.tv_nsec) / 1000000));
+}
+
+static struct history_stream *history_get_stream(uint8_t sensor_id, int channel) {
+    struct history_stream *stream = __atomic_load_n(&m_streams[sensor_id][channel], __ATOMIC_ACQUIRE);
+
+    if (stream != NULL)
+        return stream;
+
+    pthread_mutex_lock(&m_alloc_lock);
+    stream = m_streams[sensor_id][channel];
+    if (stream == NULL) {
+        stream = calloc(1, sizeof(*stream));
+        if (stream != NULL) {
+            pthread_mutex_init(&stream->lock, NULL);
+            __atomic_store_n(&m_streams[sensor_id][channel], stream, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&m_alloc_lock);
+    return stream;
+}
+
+// One line, ended like every message so the consumer can split the chunks
+static int history_format(char *out, uint8_t sensor_id, int channel, const struct history_sample *sample) {
+    char tag[8] = "";
+    int n;
+
+    if (sensor_id != 0)
+        snprintf(tag, sizeof(tag), "%c%u", DISPATCH_SENSOR_TAG, sensor_id);
+
+    if (shm_cache_channel_axes[channel] == 4)
+        n = snprintf(out, HISTORY_LINE_SZ - 1, "<%s%s @%u>: (w %.4f, x %.4f, y %.4f, z %.4f)",
+                     shm_cache_channel_token[channel], tag, sample->time_ms,
+                     sample->value[0], sample->value[1], sample->value[2], sample->value[3]);
+    else
+        n = snprintf(out, HISTORY_LINE_SZ - 1, "<%s%s @%u>: (x %.4f, y %.4f, z %.4f)",
+                     shm_cache_channel_token[channel], tag, sample->time_ms,
+                     sample->value[0], sample->value[1], sample->value[2]);
+    // Huge values are cut, the end of the line is not
+    if (n > HISTORY_LINE_SZ - 2)
+        n = HISTORY_LINE_SZ - 2;
+    out[n++] = DISPATCH_MESSAGE_END;
+    return n;
+}
+
+// Queue text for a subscriber (fan out lock held)
+static int history_queue(struct history_subscriber *sub, const char *text, size_t n) {
+    if (sub->len - sub->sent + n > HISTORY_PENDING_MAX)
+        return 1;
+
+    if (sub->len + n > sub->cap) {
+        size_t cap = (sub->cap != 0) ? sub->cap : HISTORY_CHUNK_SZ;
+        char *pending;
+
+        while (cap < sub->len + n)
+            cap *= 2;
+        pending = realloc(sub->pending, cap);
+        if (pending == NULL)
+            return 1;
+        sub->pending = pending;
+        sub->cap = cap;
+    }
+    memcpy(sub->pending + sub->len, text, n);
+    sub->len += n;
+    return 0;
+}
+
+// Release a subscriber (fan out lock held)
+static void history_release(struct history_subscriber *sub) {
+    free(sub->backlog);
+    sub->backlog = NULL;
+    free(sub->pending);
+    sub->pending = NULL;
+    sub->len = sub->cap = sub->sent = 0;
+    sub->socket = TCP_NO_SOCKET;
+    sub->state = HISTORY_FREE;
+    __atomic_sub_fetch(&m_subscriber_count, 1, __ATOMIC_SEQ_CST);
+}
+
+// Next lines of the backlog, then its end line; 0 once both are out (no lock)
+static size_t history_backlog_chunk(struct history_subscriber *sub, char *chunk) {
+    size_t n = 0;
+
+    if (sub->backlog == NULL)
+        return 0;
+
+    while (sub->backlog_next < sub->backlog_count && n + HISTORY_LINE_SZ <= HISTORY_CHUNK_SZ) {
+        const struct history_entry *entry = &sub->backlog[sub->backlog_next++];
+
+        n += (size_t)history_format(chunk + n, entry->sensor_id, entry->channel, &entry->sample);
+    }
+    if (sub->backlog_next == sub->backlog_count && n + HISTORY_LINE_SZ <= HISTORY_CHUNK_SZ) {
+        n += (size_t)snprintf(chunk + n, HISTORY_LINE_SZ, "<Replay end>: (%u samples%s)%c", sub->backlog_count,
+                              sub->truncated ? ", truncated" : "", DISPATCH_MESSAGE_END);
+        free(sub->backlog);
+        sub->backlog = NULL;
+    }
+    return n;
+}
+
+// Sends the backlog of a subscriber in bulk chunks, then its live samples for
+// as long as it stays
+static void *history_worker(void *param) {
+    struct history_subscriber *sub = (struct history_subscriber *)param;
+    char chunk[HISTORY_CHUNK_SZ];
+    _sSocket_t socket;
+    size_t n = 0;                   // Bytes of chunk not sent yet
+    int err;
+
+    pthread_detach(pthread_self());
+
+    pthread_mutex_lock(&m_fanout_lock);
+    while (1) {
+        if (sub->state == HISTORY_CLOSING) {
+            history_release(sub);
+            break;
+        }
+        if (n == 0 && sub->state == HISTORY_JOINING) {
+            // Formatted outside the locks; live samples queue up meanwhile
+            pthread_mutex_unlock(&m_fanout_lock);
+            n = history_backlog_chunk(sub, chunk);
+            pthread_mutex_lock(&m_fanout_lock);
+            if (n == 0 && sub->state == HISTORY_JOINING)
+                sub->state = HISTORY_LIVE;
+            continue;
+        }
+        if (n == 0 && sub->sent == sub->len) {
+            sub->len = sub->sent = 0;
+            pthread_cond_wait(&sub->wake, &m_fanout_lock);
+            continue;
+        }
+        if (n == 0) {
+            n = sub->len - sub->sent;
+            if (n > sizeof(chunk)) {
+                // Whole lines only: the queue holds lines far shorter than a chunk
+                const char *last = memrchr(sub->pending + sub->sent, DISPATCH_MESSAGE_END, sizeof(chunk));
+
+                n = (last != NULL) ? (size_t)(last - (sub->pending + sub->sent)) + 1 : sizeof(chunk);
+            }
+            memcpy(chunk, sub->pending + sub->sent, n);
+            sub->sent += n;
+            if (sub->sent > sub->cap / 2) {
+                // Keep the queue from creeping towards the end of the buffer
+                memmove(sub->pending, sub->pending + sub->sent, sub->len - sub->sent);
+                sub->len -= sub->sent;
+                sub->sent = 0;
+            }
+        }
+        socket = sub->socket;
+        pthread_mutex_unlock(&m_fanout_lock);
+
+        // Sent outside the lock: ingest only waits for the queue copies
+        err = TCPSendData(socket, chunk, (uint16_t)n);
+
+        pthread_mutex_lock(&m_fanout_lock);
+        if (err == ERRCODE_NO_ERROR) {
+            n = 0;
+        } else if (!TCPIsConnected(socket)) {
+            sub->state = HISTORY_CLOSING;
+        } else {
+            // Send area of the engine full: wait for it to drain
+            pthread_mutex_unlock(&m_fanout_lock);
+            usleep(1000);
+            pthread_mutex_lock(&m_fanout_lock);
+        }
+    }
+    pthread_mutex_unlock(&m_fanout_lock);
+    return NULL;
+}
+
+void history_init() {
+    clock_gettime(CLOCK_MONOTONIC, &m_epoch);
+    for (int i = 0; i < HISTORY_MAX_SUBSCRIBERS; i++) {
+        m_subscribers[i].socket = TCP_NO_SOCKET;
+        pthread_cond_init(&m_subscribers[i].wake, NULL);
+    }
+}
+
+void history_append(uint8_t sensor_id, int channel, const float *value, unsigned count) {
+    struct history_stream *stream;
+    struct history_sample sample;
+    char line[HISTORY_LINE_SZ];
+    int n = 0;
+    uint64_t seq;
+
+    if (sensor_id >= SHM_CACHE_MAX_SENSORS || channel < 0 || channel >= SHM_CACHE_CHANNELS || count > 4)
+        return;
+
+    stream = history_get_stream(sensor_id, channel);
+    if (stream == NULL)
+        return;
+
+    sample.time_ms = history_now_ms();
+    memset(sample.value, 0, sizeof(sample.value));
+    memcpy(sample.value, value, count * sizeof(float));
+
+    pthread_mutex_lock(&stream->lock);
+    seq = stream->head++;
+    stream->samples[seq & (HISTORY_CAPACITY - 1)] = sample;
+    pthread_mutex_unlock(&stream->lock);
+
+    // A replay counts its subscriber before cutting the streams, so a sample
+    // missing from its backlog always sees it here
+    if (__atomic_load_n(&m_subscriber_count, __ATOMIC_SEQ_CST) == 0)
+        return;
+
+    pthread_mutex_lock(&m_fanout_lock);
+    for (int i = 0; i < HISTORY_MAX_SUBSCRIBERS; i++) {
+        struct history_subscriber *sub = &m_subscribers[i];
+
+        if ((sub->state != HISTORY_JOINING && sub->state != HISTORY_LIVE) ||
+            seq < __atomic_load_n(&sub->cut[sensor_id][channel], __ATOMIC_ACQUIRE))
+            continue;
+
+        // Only queued: a consumer with a full socket must not hold up the other ingest threads
+        if (n == 0)
+            n = history_format(line, sensor_id, channel, &sample);
+        if (history_queue(sub, line, (size_t)n))
+            sub->state = HISTORY_CLOSING;
+        pthread_cond_signal(&sub->wake);
+    }
+    pthread_mutex_unlock(&m_fanout_lock);
+}
+
+int history_replay(_sSocket_t socket, uint32_t seconds) {
+    struct history_subscriber *sub = NULL;
+    struct history_entry *backlog;
+    uint32_t now = history_now_ms();
+    uint32_t window = (seconds > now / 1000) ? now : seconds * 1000;
+    uint32_t count = 0;
+    bool truncated = false;
+
+    backlog = malloc(HISTORY_REPLAY_MAX * sizeof(*backlog));
+    if (backlog == NULL)
+        return 1;
+
+    pthread_mutex_lock(&m_fanout_lock);
+    for (int i = 0; i < HISTORY_MAX_SUBSCRIBERS; i++) {
+        if (m_subscribers[i].socket == socket &&
+            (m_subscribers[i].state == HISTORY_JOINING || m_subscribers[i].state == HISTORY_LIVE)) {
+            // Asked again: start over with a new backlog
+            m_subscribers[i].state = HISTORY_CLOSING;
+            pthread_cond_signal(&m_subscribers[i].wake);
+        }
+        if (sub == NULL && m_subscribers[i].state == HISTORY_FREE)
+            sub = &m_subscribers[i];
+    }
+    if (sub == NULL) {
+        pthread_mutex_unlock(&m_fanout_lock);
+        free(backlog);
+        return 1;
+    }
+
+    // Nothing is forwarded before its stream is cut
+    sub->socket = socket;
+    sub->state = HISTORY_JOINING;
+    memset(sub->cut, 0xFF, sizeof(sub->cut));
+    __atomic_add_fetch(&m_subscriber_count, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&m_fanout_lock);
+
+    // Only binary copies under the stream locks; a stream created meanwhile is live from its first sample
+    pthread_mutex_lock(&m_alloc_lock);
+    for (int sensor = 0; sensor < SHM_CACHE_MAX_SENSORS; sensor++) {
+        for (int channel = 0; channel < SHM_CACHE_CHANNELS; channel++) {
+            struct history_stream *stream = m_streams[sensor][channel];
+            uint64_t first;
+
+            if (stream == NULL) {
+                __atomic_store_n(&sub->cut[sensor][channel], 0, __ATOMIC_RELEASE);
+                continue;
+            }
+
+            pthread_mutex_lock(&stream->lock);
+            first = (stream->head > HISTORY_CAPACITY) ? stream->head - HISTORY_CAPACITY : 0;
+            for (uint64_t seq = first; seq < stream->head && window != 0; seq++) {
+                const struct history_sample *sample = &stream->samples[seq & (HISTORY_CAPACITY - 1)];
+
+                if (sample->time_ms < now - window)
+                    continue;
+                if (count == HISTORY_REPLAY_MAX) {
+                    truncated = true;
+                    break;
+                }
+                backlog[count].sample = *sample;
+                backlog[count].sensor_id = (uint8_t)sensor;
+                backlog[count].channel = (uint8_t)channel;
+                count++;
+            }
+            __atomic_store_n(&sub->cut[sensor][channel], stream->head, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&stream->lock);
+        }
+    }
+    pthread_mutex_unlock(&m_alloc_lock);
+
+    pthread_mutex_lock(&m_fanout_lock);
+    sub->backlog = backlog;
+    sub->backlog_count = count;
+    sub->backlog_next = 0;
+    sub->truncated = truncated;
+    if (threadCreate(&sub->worker, "Replay", history_worker, sub)) {
+        history_release(sub);
+        pthread_mutex_unlock(&m_fanout_lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&m_fanout_lock);
+    return 0;
+}
+
+void history_unsubscribe(_sSocket_t socket) {
+    pthread_mutex_lock(&m_fanout_lock);
+    for (int i = 0; i < HISTORY_MAX_SUBSCRIBERS; i++) {
+        struct history_subscriber *sub = &m_subscribers[i];
+
+        if (sub->socket != socket || sub->state == HISTORY_FREE)
+            continue;
+        sub->state = HISTORY_CLOSING;
+        pthread_cond_signal(&sub->wake);
+    }
+    pthread_mutex_unlock(&m_fanout_lock);
+}
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file    history.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+#include <stdint.h>
+
+#include "tcp.h"
+
+// Samples kept per stream (sensor and channel), power of 2: ~40 s at 100 Hz
+#define HISTORY_CAPACITY            4096
+
+// Consumers in replay or live at the same time
+#define HISTORY_MAX_SUBSCRIBERS     TCP_NUMBER_CLIENTS_TO_SERVER
+
+// Bulk send size; fits the send area of the io_uring engine
+#define HISTORY_CHUNK_SZ            (4 * TCP_BUFFER_SZ)
+
+// Live text waiting for a consumer; above it the consumer is dropped
+#define HISTORY_PENDING_MAX         (1024 * 1024)
+
+// Samples in one replay backlog; above it the backlog is truncated
+#define HISTORY_REPLAY_MAX          (16 * 1024)
+
+struct history_sample {
+    uint32_t time_ms;               // Monotonic, from history_init
+    float value[4];
+};
+
+/**
+ * @brief Start the clock of the samples
+ */
+void history_init();
+
+/**
+ * @brief Store a sample and forward it to the live consumers. The ring of
+ * the stream is allocated on its first sample.
+ *
+ * @param sensor_id: Sensor tag of the message
+ * @param channel: One of enum shm_cache_channel
+ * @param value: count values, up to 4
+ */
+void history_append(uint8_t sensor_id, int channel, const float *value, unsigned count);
+
+/**
+ * @brief Send the last seconds of every stream to a consumer, then keep it
+ * live. The backlog is copied as samples and formatted by a worker thread of
+ * the consumer, which sends it in bulk chunks and then the live samples
+ * queued behind it, so nothing is lost or repeated and neither the replay
+ * nor a slow consumer holds up the ingest.
+ *
+ * @param socket: Consumer connection
+ * @param seconds: Backlog length; 0 goes live right away
+ * @return 0 on success, 1 when there is no room for another consumer
+ */
+int history_replay(_sSocket_t socket, uint32_t seconds);
+
+/**
+ * @brief Forget a consumer, from the server connection callback
+ */
+void history_unsubscribe(_sSocket_t socket);
+
+#endif /* HISTORY_H_ */
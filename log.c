@@ -0,0 +1,365 @@
+/**
+ ******************************************************************************
+ * @file    log.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+#include "thread_wrapper.h"
+
+// Longest formatted message
+#define LOG_LINE_SZ         512
+
+struct log_record {
+    uint64_t time_ns;
+    struct log_site *site;
+    uint8_t count;
+    uint8_t type[LOG_MAX_ARGS];
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+        uint32_t offset;            // Of a string in strings
+    } value[LOG_MAX_ARGS];
+    char strings[LOG_STRINGS_SZ];
+};
+
+// Queue of one thread: the thread produces, the writer consumes
+struct log_ring {
+    struct log_ring *next;
+    uint32_t tid;
+    bool dead;                      // Thread finished; released once drained
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t dropped;
+    uint32_t tail __attribute__((aligned(64)));
+    struct log_record records[LOG_RING_SZ];
+};
+
+int log_min_level = LOG_LEVEL_INFO;
+
+static uint32_t m_rate = LOG_DEFAULT_RATE;
+static struct log_ring *m_rings = NULL;         // Lock-free push at the head
+static struct log_site *m_suppressed = NULL;    // Lock-free push at the head
+static bool m_running = false;
+static bool m_stop = false;
+static sThread_t m_writer;
+static pthread_key_t m_ring_key;
+static pthread_once_t m_ring_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct log_ring *m_ring = NULL;
+
+static uint64_t log_now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+static void log_thread_end(void *ring) {
+    __atomic_store_n(&((struct log_ring *)ring)->dead, true, __ATOMIC_RELEASE);
+}
+
+static void log_create_key() {
+    pthread_key_create(&m_ring_key, log_thread_end);
+}
+
+// First message of a thread: create and publish its ring
+static struct log_ring *log_new_ring() {
+    struct log_ring *ring = calloc(1, sizeof(*ring));
+
+    if (ring == NULL)
+        return NULL;
+    ring->tid = (uint32_t)syscall(SYS_gettid);
+
+    pthread_once(&m_ring_once, log_create_key);
+    pthread_setspecific(m_ring_key, ring);
+
+    ring->next = __atomic_load_n(&m_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&m_rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return ring;
+}
+
+// Over the rate of its site this second; listed so the writer reports it
+static bool log_rate_limited(struct log_site *site, uint64_t now_ns) {
+    uint32_t second = (uint32_t)(now_ns / 1000000000ull);
+    uint32_t window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+    uint32_t rate = __atomic_load_n(&m_rate, __ATOMIC_RELAXED);
+
+    if (rate == 0)
+        return false;
+
+    if (window != second && __atomic_compare_exchange_n(&site->window, &window, second, false,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+
+    if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) < rate)
+        return false;
+
+    __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+    if (!__atomic_exchange_n(&site->listed, 1, __ATOMIC_ACQ_REL)) {
+        site->next = __atomic_load_n(&m_suppressed, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&m_suppressed, &site->next, site, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    return true;
+}
+
+void _log_write(struct log_site *site, unsigned count, const struct log_arg *args) {
+    struct log_ring *ring = m_ring;
+    struct log_record *rec;
+    uint64_t now = log_now_ns();
+    uint32_t head;
+    size_t used = 0;
+
+    if (log_rate_limited(site, now))
+        return;
+
+    if (ring == NULL) {
+        ring = m_ring = log_new_ring();
+        if (ring == NULL)
+            return;
+    }
+
+    head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SZ) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = &ring->records[head & (LOG_RING_SZ - 1)];
+    rec->time_ns = now;
+    rec->site = site;
+    rec->count = (uint8_t)((count > LOG_MAX_ARGS) ? LOG_MAX_ARGS : count);
+    for (unsigned i = 0; i < rec->count; i++) {
+        rec->type[i] = args[i].type;
+        if (args[i].type != LOG_ARG_STR) {
+            rec->value[i].u = args[i].v.u;
+            continue;
+        }
+
+        // Strings may not outlive the call: copy them, cut to the room left
+        rec->value[i].offset = (uint32_t)used;
+        if (args[i].v.p == NULL || used == LOG_STRINGS_SZ) {
+            rec->value[i].offset = LOG_STRINGS_SZ - 1;
+            rec->strings[LOG_STRINGS_SZ - 1] = 0;
+            continue;
+        }
+        size_t n = strnlen(args[i].v.p, LOG_STRINGS_SZ - used - 1);
+        memcpy(&rec->strings[used], args[i].v.p, n);
+        rec->strings[used + n] = 0;
+        used += n + 1;
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+// Writer side
+
+// Run one conversion of the format with the captured argument
+static int log_convert(char *out, size_t size, const char *spec, size_t spec_len, char conversion,
+                       const struct log_record *rec, unsigned arg) {
+    char format[32];
+    uint8_t type;
+
+    if (arg >= rec->count)
+        return snprintf(out, size, "(?)");
+    type = rec->type[arg];
+
+    // Flags, width and precision of the call; the length follows the captured type
+    if (spec_len > sizeof(format) - 4)
+        spec_len = sizeof(format) - 4;
+    memcpy(format, spec, spec_len);
+
+    switch (conversion) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        if (conversion == 'c') {
+            format[spec_len] = 'c';
+            format[spec_len + 1] = 0;
+            return snprintf(out, size, format, (int)rec->value[arg].i);
+        }
+        format[spec_len] = 'l';
+        format[spec_len + 1] = 'l';
+        format[spec_len + 2] = conversion;
+        format[spec_len + 3] = 0;
+        if (type == LOG_ARG_DOUBLE)
+            return snprintf(out, size, format, (long long)rec->value[arg].d);
+        if (conversion == 'd' || conversion == 'i')
+            return snprintf(out, size, format, (long long)rec->value[arg].i);
+        return snprintf(out, size, format, (unsigned long long)rec->value[arg].u);
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        format[spec_len] = conversion;
+        format[spec_len + 1] = 0;
+        if (type == LOG_ARG_INT)
+            return snprintf(out, size, format, (double)rec->value[arg].i);
+        if (type == LOG_ARG_UINT)
+            return snprintf(out, size, format, (double)rec->value[arg].u);
+        return snprintf(out, size, format, rec->value[arg].d);
+    case 's':
+        if (type != LOG_ARG_STR)
+            return snprintf(out, size, "(?)");
+        format[spec_len] = 's';
+        format[spec_len + 1] = 0;
+        return snprintf(out, size, format, &rec->strings[rec->value[arg].offset]);
+    case 'p':
+        return snprintf(out, size, "%p", rec->value[arg].p);
+    default:
+        return snprintf(out, size, "(?)");
+    }
+}
+
+// printf formatting from the captured arguments
+static size_t log_format(char *out, size_t size, const struct log_record *rec) {
+    const char *cursor = rec->site->format;
+    unsigned arg = 0;
+    size_t len = 0;
+
+    while (*cursor != 0 && len < size - 1) {
+        const char *spec = cursor;
+        int n;
+
+        if (*cursor != '%') {
+            out[len++] = *cursor++;
+            continue;
+        }
+        if (cursor[1] == '%') {
+            out[len++] = '%';
+            cursor += 2;
+            continue;
+        }
+
+        cursor++;
+        while (*cursor != 0 && strchr("-+ #0", *cursor) != NULL)
+            cursor++;
+        while ((*cursor >= '0' && *cursor <= '9') || *cursor == '.')
+            cursor++;
+        n = (int)(cursor - spec);
+        while (*cursor != 0 && strchr("hljztL", *cursor) != NULL)
+            cursor++;
+        if (*cursor == 0)
+            break;
+
+        n = log_convert(&out[len], size - len, spec, (size_t)n, *cursor, rec, arg++);
+        cursor++;
+        if (n > 0)
+            len += ((size_t)n < size - len) ? (size_t)n : size - len - 1;
+    }
+    out[len] = 0;
+    return len;
+}
+
+// Write what the rings hold, oldest first across threads
+static void log_drain() {
+    struct log_ring *prev = NULL;
+    struct log_ring *next;
+    char line[LOG_LINE_SZ];
+
+    while (1) {
+        struct log_ring *oldest = NULL;
+        struct log_record *rec;
+        uint32_t tail;
+
+        for (struct log_ring *ring = __atomic_load_n(&m_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+            tail = ring->tail;
+            if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+                continue;
+            if (oldest == NULL ||
+                ring->records[tail & (LOG_RING_SZ - 1)].time_ns <
+                oldest->records[oldest->tail & (LOG_RING_SZ - 1)].time_ns)
+                oldest = ring;
+        }
+        if (oldest == NULL)
+            break;
+
+        tail = oldest->tail;
+        rec = &oldest->records[tail & (LOG_RING_SZ - 1)];
+        log_format(line, sizeof(line), rec);
+        __atomic_store_n(&oldest->tail, tail + 1, __ATOMIC_RELEASE);
+        fputs(line, stdout);
+    }
+
+    // Losses of this period: full queues, then sites over the rate
+    for (struct log_ring *ring = __atomic_load_n(&m_rings, __ATOMIC_ACQUIRE); ring != NULL; ring = next) {
+        uint32_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+
+        next = ring->next;
+        if (dropped)
+            printf("<Log>: %u messages lost, queue of thread %u full\n", dropped, ring->tid);
+
+        // The head of the list races with the pushes: only the others are released
+        if (prev != NULL && __atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+            prev->next = next;
+            free(ring);
+            continue;
+        }
+        prev = ring;
+    }
+    for (struct log_site *site = __atomic_load_n(&m_suppressed, __ATOMIC_ACQUIRE); site != NULL; site = site->next) {
+        uint32_t suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+
+        const char *file = strrchr(site->file, '/');
+
+        if (suppressed)
+            printf("<Log>: %u messages suppressed at %s:%d\n", suppressed,
+                   (file != NULL) ? file + 1 : site->file, site->line);
+    }
+    fflush(stdout);
+}
+
+static void *log_writer(void *param) {
+    while (!__atomic_load_n(&m_stop, __ATOMIC_ACQUIRE)) {
+        usleep(LOG_FLUSH_PERIOD_MS * 1000);
+        log_drain();
+    }
+    return NULL;
+}
+
+int log_init() {
+    if (m_running)
+        return 0;
+
+    m_stop = false;
+    if (threadCreate(&m_writer, "Log", log_writer, NULL))
+        return 1;
+    m_running = true;
+    return 0;
+}
+
+void log_finish() {
+    if (!m_running)
+        return;
+
+    __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+    pthread_join(m_writer.handle, NULL);
+    m_running = false;
+    log_drain();
+}
+
+void log_set_level(int level) {
+    log_min_level = level;
+}
+
+void log_set_rate(uint32_t per_second) {
+    __atomic_store_n(&m_rate, per_second, __ATOMIC_RELAXED);
+}
+
+int log_parse_level(const char *name) {
+    static const char *names[] = {"debug", "info", "warn", "error"};
+
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
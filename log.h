@@ -0,0 +1,159 @@
+/**
+ ******************************************************************************
+ * @file    log.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+#include <stdint.h>
+#include <stdio.h>
+
+// Records queued per thread (power of 2); when full, new records are counted and dropped
+#define LOG_RING_SZ             1024
+
+// Arguments of one call
+#define LOG_MAX_ARGS            8
+
+// Room for the string arguments of one call, copied when logged; longer ones are cut
+#define LOG_STRINGS_SZ          160
+
+// Period of the writer thread, in ms
+#define LOG_FLUSH_PERIOD_MS     10
+
+// Messages per second from one call site before the rest of the second is suppressed
+#define LOG_DEFAULT_RATE        1000
+
+enum log_level {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+};
+
+enum log_arg_type {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR,
+    LOG_ARG_PTR,
+};
+
+struct log_arg {
+    uint8_t type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+    } v;
+};
+
+// One per LOG call, static: the format string is the id of the message
+struct log_site {
+    const char *file;
+    int line;
+    const char *format;
+    uint32_t window;                // Second of the current rate window
+    uint32_t count;                 // Messages in the window
+    uint32_t suppressed;            // Over the rate, not reported yet
+    uint8_t listed;
+    struct log_site *next;          // Sites with suppressed messages
+};
+
+// Lowest level recorded
+extern int log_min_level;
+
+/**
+ * @brief Queue one message; use the LOG_* macros
+ */
+void _log_write(struct log_site *site, unsigned count, const struct log_arg *args);
+
+/**
+ * @brief Start the writer thread. Messages are formatted and written to
+ * stdout there, in time order across threads.
+ *
+ * @return 0 on success, 1 on failure
+ */
+int log_init();
+
+/**
+ * @brief Stop the writer thread, writing what is still queued
+ */
+void log_finish();
+
+/**
+ * @brief Set the lowest level recorded, LOG_LEVEL_INFO by default
+ */
+void log_set_level(int level);
+
+/**
+ * @brief Set the rate limit of every call site
+ * @param per_second: Messages per second and call site, 0 for no limit
+ */
+void log_set_rate(uint32_t per_second);
+
+/**
+ * @brief Parse a level name: debug, info, warn or error
+ * @return Level, or -1 when unknown
+ */
+int log_parse_level(const char *name);
+
+/*****************************************************************************/
+// Arguments are captured raw, with their type; formatting waits for the writer
+
+static inline struct log_arg _log_int(int64_t v) { struct log_arg a = {LOG_ARG_INT, {.i = v}}; return a; }
+static inline struct log_arg _log_uint(uint64_t v) { struct log_arg a = {LOG_ARG_UINT, {.u = v}}; return a; }
+static inline struct log_arg _log_double(double v) { struct log_arg a = {LOG_ARG_DOUBLE, {.d = v}}; return a; }
+static inline struct log_arg _log_str(const char *v) { struct log_arg a = {LOG_ARG_STR, {.p = v}}; return a; }
+static inline struct log_arg _log_ptr(const void *v) { struct log_arg a = {LOG_ARG_PTR, {.p = v}}; return a; }
+
+#define _LOG_ARG(x) _Generic((x),                                               \
+    _Bool: _log_uint, char: _log_int, signed char: _log_int, unsigned char: _log_uint, \
+    short: _log_int, unsigned short: _log_uint, int: _log_int, unsigned: _log_uint,     \
+    long: _log_int, unsigned long: _log_uint,                                   \
+    long long: _log_int, unsigned long long: _log_uint,                         \
+    float: _log_double, double: _log_double,                                    \
+    char *: _log_str, const char *: _log_str,                                   \
+    default: _log_ptr)(x)
+
+#define _LOG_COUNT(...)     _LOG_PICK(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0, -1)
+#define _LOG_PICK(f, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define _LOG_FORMAT(...)    _LOG_FIRST(__VA_ARGS__, 0)
+#define _LOG_FIRST(f, ...)  f
+#define _LOG_CAT(a, b)      _LOG_CAT2(a, b)
+#define _LOG_CAT2(a, b)     a##b
+
+#define _LOG_ARGS_0(f)
+#define _LOG_ARGS_1(f, a)                       , _LOG_ARG(a)
+#define _LOG_ARGS_2(f, a, b)                    _LOG_ARGS_1(f, a), _LOG_ARG(b)
+#define _LOG_ARGS_3(f, a, b, c)                 _LOG_ARGS_2(f, a, b), _LOG_ARG(c)
+#define _LOG_ARGS_4(f, a, b, c, d)              _LOG_ARGS_3(f, a, b, c), _LOG_ARG(d)
+#define _LOG_ARGS_5(f, a, b, c, d, e)           _LOG_ARGS_4(f, a, b, c, d), _LOG_ARG(e)
+#define _LOG_ARGS_6(f, a, b, c, d, e, g)        _LOG_ARGS_5(f, a, b, c, d, e), _LOG_ARG(g)
+#define _LOG_ARGS_7(f, a, b, c, d, e, g, h)     _LOG_ARGS_6(f, a, b, c, d, e, g), _LOG_ARG(h)
+#define _LOG_ARGS_8(f, a, b, c, d, e, g, h, k)  _LOG_ARGS_7(f, a, b, c, d, e, g, h), _LOG_ARG(k)
+
+/**
+ * @brief Log a printf style message. The format must be a string literal;
+ * the printf call is never run and only keeps the format checks.
+ */
+#define LOG(level, ...) do {                                                    \
+    static struct log_site _log_site = {__FILE__, __LINE__, _LOG_FORMAT(__VA_ARGS__), 0, 0, 0, 0, NULL}; \
+    if (0)                                                                      \
+        printf(__VA_ARGS__);                                                    \
+    if ((level) >= log_min_level) {                                             \
+        const struct log_arg _log_args[] = {                                    \
+            {0} _LOG_CAT(_LOG_ARGS_, _LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)      \
+        };                                                                      \
+        _log_write(&_log_site, _LOG_COUNT(__VA_ARGS__), &_log_args[1]);         \
+    }                                                                           \
+} while (0)
+
+#define LOG_DEBUG(...)  LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)   LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)   LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...)  LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif /* LOG_H_ */
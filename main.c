@@ -2,111 +2,322 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <time.h>
 
 #include "tcp.h"
+#include "codec.h"
 #include "mpu6050.h"
+#include "acquisition.h"
+#include "dispatch.h"
+#include "fusion.h"
+#include "report.h"
+#include "scheduler.h"
+#include "shm_cache.h"
+#include "relay.h"
+#include "history.h"
+#include "rules.h"
+#include "trace.h"
+#include "log.h"
 
 static _sSocket_t m_socketId;
 
 #ifndef CLIENT_MODE
-static _sSocket_t m_clientSocketId;
+// Sensor ids with delta tracking; higher tags are parsed and dropped
+#define SERVER_MAX_SENSORS	SHM_CACHE_MAX_SENSORS
+
+struct server_sensor {
+	float accel[3];
+	float gyro[3];
+	float angles[3];
+};
+
+static struct server_sensor m_sensors[SERVER_MAX_SENSORS];
+// Relay mode: samples are merged and forwarded upstream instead of answered
+static bool m_relay = false;
 #endif
 
-static float m_accel_x, m_accel_y, m_accel_z = 0;
-static float m_gyro_x, m_gyro_y, m_gyro_z = 0;
+// Message token with the sensor tag, "Accel" for sensor 0 and "Accel#<id>" otherwise
+static const char *tagged_name(char *out, size_t size, const char *name, uint8_t sensor_id)
+{
+	if (sensor_id == 0)
+		snprintf(out, size, "%s", name);
+	else
+		snprintf(out, size, "%s%c%u", name, DISPATCH_SENSOR_TAG, sensor_id);
+	return out;
+}
+
+#ifndef CLIENT_MODE
+static uint16_t handle_delta(const char *name, int channel, uint8_t sensor_id, size_t offset,
+							 const char *body, uint16_t len)
+{
+	char sendBuffer[1024] = {0};
+	char tag[DISPATCH_MAX_TOKEN_SZ + 1];
+	float value[3];
+	float delta[3];
+	float *last;
+	uint16_t consumed;
+
+	// Same grammar and values as sscanf(" %f-%f-%f%n"), several times faster
+	if ((consumed = codec_parse_floats(body, len, value, 3)) == 0)
+		return 0;
+	if (m_relay) {
+		relay_ingest(TCPGetRxSocket(), sensor_id, channel, value, 3);
+		return consumed;
+	}
+	if (sensor_id >= SERVER_MAX_SENSORS)
+		return consumed;
+
+	last = (float *)((uint8_t *)&m_sensors[sensor_id] + offset);
+	for (int i = 0; i < 3; i++) {
+		delta[i] = last[i] - value[i];
+		last[i] = value[i];
+	}
+	shm_cache_publish(sensor_id, channel, value, delta, 3);
+	history_append(sensor_id, channel, value, 3);
+	rules_ingest(TCPGetRxSocket(), sensor_id, channel, value, 3);
+
+	tagged_name(tag, sizeof(tag), name, sensor_id);
+	LOG_INFO("<%s message>: (x %f, y %f, z %f)\n", tag, value[0], value[1], value[2]);
+	TCPSendData(TCPGetRxSocket(), sendBuffer, (uint16_t)codec_format_delta(sendBuffer, tag, delta));
+	return consumed;
+}
+
+static uint16_t accel_handler(uint8_t sensor_id, const char *body, uint16_t len)
+{
+	return handle_delta("Accel", SHM_CACHE_ACCEL, sensor_id, offsetof(struct server_sensor, accel), body, len);
+}
+
+static uint16_t gyro_handler(uint8_t sensor_id, const char *body, uint16_t len)
+{
+	return handle_delta("Gyro", SHM_CACHE_GYRO, sensor_id, offsetof(struct server_sensor, gyro), body, len);
+}
+
+static uint16_t euler_handler(uint8_t sensor_id, const char *body, uint16_t len)
+{
+	return handle_delta("Angles", SHM_CACHE_ANGLES, sensor_id, offsetof(struct server_sensor, angles), body, len);
+}
+
+static uint16_t quat_handler(uint8_t sensor_id, const char *body, uint16_t len)
+{
+	char tag[DISPATCH_MAX_TOKEN_SZ + 1];
+	float q[4];
+	uint16_t consumed;
+
+	if ((consumed = codec_parse_floats(body, len, q, 4)) == 0)
+		return 0;
+	if (m_relay) {
+		relay_ingest(TCPGetRxSocket(), sensor_id, SHM_CACHE_QUAT, q, 4);
+		return consumed;
+	}
+
+	shm_cache_publish(sensor_id, SHM_CACHE_QUAT, q, NULL, 4);
+	history_append(sensor_id, SHM_CACHE_QUAT, q, 4);
+	rules_ingest(TCPGetRxSocket(), sensor_id, SHM_CACHE_QUAT, q, 4);
+	LOG_INFO("<%s message>: (w %f, x %f, y %f, z %f)\n", tagged_name(tag, sizeof(tag), "Quat", sensor_id),
+		   q[0], q[1], q[2], q[3]);
+	return consumed;
+}
+
+// "Replay: <seconds>" from a consumer: the last seconds of every sensor, then live
+static uint16_t replay_handler(uint8_t sensor_id, const char *body, uint16_t len)
+{
+	char text[24];
+	char *end;
+	unsigned long seconds;
+	uint16_t consumed;
+	int n;
+
+	// Within len: the body runs into the next message of the read
+	n = (len < sizeof(text)) ? len : (int)sizeof(text) - 1;
+	memcpy(text, body, (size_t)n);
+	text[n] = '\0';
+	seconds = strtoul(text, &end, 10);
+	if (end == text || seconds > UINT32_MAX)
+		return 0;
+	consumed = (uint16_t)(end - text);
+
+	if (history_replay(TCPGetRxSocket(), (uint32_t)seconds)) {
+		n = snprintf(text, sizeof(text), "<Replay refused>%c", DISPATCH_MESSAGE_END);
+		TCPSendData(TCPGetRxSocket(), text, (uint16_t)n);
+	}
+	return consumed;
+}
 
-const char kAccelHeaderMsg[] = "Accel: ";
-const char kGyroHeaderMsg[] = "Gyro: ";
-const char kBodySeed = ':';
+// Reader side of the shared memory cache, as any local process would use it
+static int dump_cache()
+{
+	const struct shm_cache *cache = shm_cache_attach(SHM_CACHE_NAME);
+	struct shm_cache_sample sample;
+
+	if (cache == NULL) {
+		printf("No shared memory cache %s\n", SHM_CACHE_NAME);
+		return EXIT_FAILURE;
+	}
+
+	for (int sensor = 0; sensor < SHM_CACHE_MAX_SENSORS; sensor++) {
+		for (int channel = 0; channel < SHM_CACHE_CHANNELS; channel++) {
+			if (shm_cache_read(cache, (uint8_t)sensor, channel, &sample))
+				continue;
+			printf("Sensor %d %s: (%f, %f, %f, %f) delta (%f, %f, %f, %f), %u updates\n",
+				   sensor, shm_cache_channel_token[channel], sample.value[0], sample.value[1], sample.value[2],
+				   sample.value[3], sample.delta[0], sample.delta[1], sample.delta[2],
+				   sample.delta[3], sample.updates);
+		}
+	}
+	shm_cache_detach(cache);
+	return EXIT_SUCCESS;
+}
+#endif
 
 static void receiverCallback(uint8_t *buffer, uint16_t len)
 {
 #ifdef CLIENT_MODE
-	printf("Message received: %s\n", buffer);
+	LOG_INFO("Message received: %s\n", (char *)buffer);
 #else
-	char sendBuffer[1024] = {0};
-	memset(sendBuffer, 0, sizeof(sendBuffer));
-	// Validade which was the received message
-	if (strstr(buffer, kAccelHeaderMsg) != NULL) {
-		char *content = strchr(buffer, kBodySeed);
-		float x, y, z = 0;
-		if(content != NULL) {
-			sscanf(content, ": %f-%f-%f", &x, &y, &z);
-			printf("<Accel message>: (x %f, y %f, z %f)\n", x, y, z);
-			sprintf(sendBuffer, "<Delta on Accel>: (x %.2f, y %.2f, z %.2f)", m_accel_x - x, m_accel_y - y, m_accel_z - z);
-			m_accel_x = x;
-			m_accel_y = y;
-			m_accel_z = z;
-		}
-	} else if (strstr(buffer, kGyroHeaderMsg) != NULL) {
-		char *content = strchr(buffer, kBodySeed);
-		float x, y, z = 0;
-		if (content != NULL)
-		{
-			sscanf(content, ": %f-%f-%f", &x, &y, &z);
-			printf("<Gyro message>: (x %f, y %f, z %f)\n", x, y, z);
-			sprintf(sendBuffer, "<Delta on Gyro>: (x %.2f, y %.2f, z %.2f)", m_gyro_x - x, m_gyro_y - y, m_gyro_z - z);
-			m_gyro_x = x;
-			m_gyro_y = y;
-			m_gyro_z = z;
-		}
-	} else {
-		printf("<Unknown message>\n");
-		return;
-	}
-	TCPSendData(m_clientSocketId, sendBuffer, strlen(sendBuffer));
+	// Message type resolved by a single table lookup on the header token; messages
+	// cut between two reads are put back together for senders that end them
+	dispatch_stream(TCPGetRxSocket(), buffer, len);
 #endif
 }
 
 static void connectionCallback(_sSocket_t socketClient, bool ConOrDiscon) {
 #ifndef CLIENT_MODE
-	m_clientSocketId = (ConOrDiscon) ? socketClient : 0;
+	if (m_relay)
+		relay_client_connected(socketClient, ConOrDiscon);
+	if (rules_count() != 0)
+		rules_client_connected(socketClient, ConOrDiscon);
+	if (!ConOrDiscon) {
+		history_unsubscribe(socketClient);
+		dispatch_stream_close(socketClient);
+	}
 #endif
-	printf("Connection status of socket %d -> %s\n", (int)socketClient, 
-			(ConOrDiscon) ? "Connected!" : "Disconnected..");
+	LOG_INFO("Connection status of socket %d -> %s\n", (int)socketClient,
+			 (ConOrDiscon) ? "Connected!" : "Disconnected..");
 }
 
 #ifdef CLIENT_MODE
-static bool get_sensor_data() {
-	static float x, y, z = 0;
-	bool must_update = false;
+// Per sensor processing state, only touched by the thread of the sensor's bus
+struct client_sensor {
+	struct report_state report;
+	struct fusion_state fusion;
+	unsigned samples;			// Since the last orientation output
+};
 
-	mpu6050_get_accel(&x, &y, &z);
-	printf("%s%f, %f, %f\n", kAccelHeaderMsg, x, y, z);
-	if (x != m_accel_x || y != m_accel_y || z != m_accel_z)
-	{
-		m_accel_x = x;
-		m_accel_y = y;
-		m_accel_z = z;
-		must_update = true;
-	}
+static struct client_sensor m_sensors[ACQUISITION_MAX_SENSORS];
+static int m_fusion_filter = FUSION_NONE;
+static unsigned m_decimation = 1;
+static bool m_euler_output = false;
 
-	mpu6050_get_gyro(&x, &y, &z);
-	printf("%s%f, %f, %f\n",kGyroHeaderMsg, x, y, z);
-	if( x != m_gyro_x || y != m_gyro_y || z != m_gyro_z) {
-		m_gyro_x = x;
-		m_gyro_y = y;
-		m_gyro_z = z;
-		must_update =  true;
-	}
+// Deadbands: 0.02 g on accel, 1 dps on gyro; full rate while moving, 2 s heartbeat
+static struct report_config m_report_config = {
+	.deadband = {0.02f, 0.02f, 0.02f, 1.0f, 1.0f, 1.0f},
+	.min_interval_ms = 10,
+	.max_interval_ms = 2000,
+};
 
-	return must_update;
+static uint64_t monotonic_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+void send_notification(struct client_sensor *sensor, const struct acquisition_sample *sample){
+	float values[REPORT_CHANNELS];
+	char name[DISPATCH_MAX_TOKEN_SZ + 1];
+	char buffer[200] = {0};
+
+	mpu6050_accel_to_g(sample->accel, &values[0]);
+	mpu6050_gyro_to_dps(sample->gyro, &values[3]);
+
+	// Noise inside the deadbands and still periods only produce heartbeats
+	if (!report_update(&sensor->report, &m_report_config, values, monotonic_ms()))
+		return;
 
-void send_notification(){
+	tagged_name(name, sizeof(name), "Accel", sample->sensor_id);
+	LOG_INFO("%s: %f, %f, %f\n", name, values[0], values[1], values[2]);
+	sprintf(buffer, "%s: %f-%f-%f", name, values[0], values[1], values[2]);
+	TCPSendData(m_socketId, buffer,  strlen(buffer));
+
+	tagged_name(name, sizeof(name), "Gyro", sample->sensor_id);
+	LOG_INFO("%s: %f, %f, %f\n", name, values[3], values[4], values[5]);
+	sprintf(buffer, "%s: %f-%f-%f", name, values[3], values[4], values[5]);
+	TCPSendData(m_socketId, buffer, strlen(buffer));
+}
+
+// Runs at the sample rate; every m_decimation samples the orientation is sent
+void send_orientation(struct client_sensor *sensor, const struct acquisition_sample *sample) {
+	char name[DISPATCH_MAX_TOKEN_SZ + 1];
 	char buffer[200] = {0};
 
-	if (get_sensor_data())
-	{
-		sprintf(buffer, "Accel: %f-%f-%f", m_accel_x, m_accel_y, m_accel_z);
-		TCPSendData(m_socketId, buffer,  strlen(buffer));
+	fusion_update(&sensor->fusion, sample->accel, sample->gyro);
+
+	if (++sensor->samples < m_decimation)
+		return;
+	sensor->samples = 0;
 
-		sprintf(buffer, "Gyro: %f-%f-%f", m_gyro_x, m_gyro_y, m_gyro_z);
-		TCPSendData(m_socketId, buffer, strlen(buffer));
+	if (m_euler_output) {
+		float euler[3];
+		fusion_get_euler(&sensor->fusion, euler);
+		sprintf(buffer, "%s: %f-%f-%f", tagged_name(name, sizeof(name), "Angles", sample->sensor_id),
+				euler[0], euler[1], euler[2]);
+	} else {
+		float q[4];
+		fusion_get_quaternion(&sensor->fusion, q);
+		sprintf(buffer, "%s: %f-%f-%f-%f", tagged_name(name, sizeof(name), "Quat", sample->sensor_id),
+				q[0], q[1], q[2], q[3]);
 	}
+	TCPSendData(m_socketId, buffer, strlen(buffer));
+}
+
+// Called by the acquisition thread of each bus
+static void sample_sink(const struct acquisition_sample *sample) {
+	struct client_sensor *sensor = &m_sensors[sample->sensor_id];
+
+	if (m_fusion_filter != FUSION_NONE)
+		send_orientation(sensor, sample);
+	else
+		send_notification(sensor, sample);
 }
+
+// Accepts "v" for the three axes or "x,y,z"
+static void parse_axes(const char *arg, float *axes) {
+	if (sscanf(arg, "%f,%f,%f", &axes[0], &axes[1], &axes[2]) != 3)
+		axes[1] = axes[2] = axes[0];
+}
+#endif
+
+static void print_stats(void *param)
+{
+#ifdef CLIENT_MODE
+	struct scheduler_stats stats;
+	int bus;
+
+	for (unsigned i = 0; (bus = acquisition_get_stats(i, &stats)) >= 0; i++) {
+		LOG_INFO("Bus %d sampling: %llu runs, %llu missed, jitter avg %llu us, max %u us\n", bus,
+				 (unsigned long long)stats.runs, (unsigned long long)stats.missed,
+				 (unsigned long long)((stats.runs != 0) ? stats.jitter_sum_ns / stats.runs / 1000 : 0),
+				 stats.jitter_max_ns / 1000);
+	}
+#else
+	LOG_INFO("Unknown messages: %u\n", dispatch_get_unknown_count());
+	if (m_relay) {
+		struct relay_stats stats;
+
+		relay_get_stats(&stats);
+		LOG_INFO("Relay: %u frames, %u messages, %u samples, %u dropped\n",
+				 stats.frames, stats.messages, stats.samples, stats.dropped);
+	}
+	if (rules_count() != 0) {
+		struct rules_stats stats;
+
+		rules_get_stats(&stats);
+		LOG_INFO("Rules: %u batches, %u samples, %u dropped, %u alerts raised, %u cleared\n",
+				 stats.batches, stats.samples, stats.dropped, stats.raised, stats.cleared);
+	}
 #endif
+}
 
 /*
  * HELP MESSAGE
@@ -114,16 +325,59 @@ void send_notification(){
 #define MESSAGE_HELP    "\n"                                                \
                         "Usage: ./socket-connector [OPTION] <PARAM> ...\n"  \
                         " -i or --ip\t\t: * IP for connection (formatted as AAA.BBB.CCC.DDD\n" \
+                        " -e or --engine\t\t: I/O engine: blocking (default) or uring\n" \
+                        " -l or --local\t\t: Local link through shared memory (server: also accept it; client: use it)\n" \
+                        " --low-latency\t\t: TCP_NODELAY and TCP_QUICKACK on every connection\n" \
+                        " --rcvbuf, --sndbuf\t: Socket buffer sizes in bytes (default: system)\n" \
+                        " --backlog\t\t: Pending connections on listen (default 8)\n" \
+                        " --busy-poll\t\t: SO_BUSY_POLL in us (needs CAP_NET_ADMIN above net.core.busy_poll)\n" \
+                        " --busy-loop\t\t: Receive spinning on <cpu> (or \"any\"), blocking engine only\n" \
+                        " -f or --fusion\t\t: Stream orientation: complementary, madgwick or mahony\n" \
+                        " -s or --sensor\t\t: Sensor as <bus>:<addr>, e.g. 1:0x69; repeat for more (default 1:0x68)\n" \
+                        " -r or --rate\t\t: Sample rate in Hz (default 100)\n" \
+                        " -o or --output-rate\t: Orientation output rate in Hz (default 10)\n" \
+                        " --cache-dump\t\t: Print the shared memory cache of a running server and exit\n" \
+                        " -p or --port\t\t: TCP port (default 1234)\n" \
+                        " -u or --upstream\t: Relay to the server at <ip>[:<port>], batching the sensor streams\n" \
+                        " --batch-ms\t\t: Relay batch period in ms (default 100)\n" \
+                        " --rules\t\t: Alert rules from <file>, evaluated every 10 ms\n" \
+                        " --trace\t\t: Record hot path events to <file>; convert with trace2json\n" \
+                        " --log-level\t\t: Lowest message level: debug, info (default), warn or error\n" \
+                        " --log-rate\t\t: Messages per second from one call site, 0 for no limit (default 1000)\n" \
+                        " --stats\t\t: Statistics period in s, 0 to disable (default 10)\n" \
+                        " --euler\t\t: Send Euler angles instead of quaternions\n" \
+                        " --deadband-accel\t: Accel deadband in g, \"v\" or \"x,y,z\" (default 0.02)\n" \
+                        " --deadband-gyro\t: Gyro deadband in dps, \"v\" or \"x,y,z\" (default 1)\n" \
+                        " --min-interval\t\t: Fastest report interval in ms, while moving (default 10)\n" \
+                        " --max-interval\t\t: Heartbeat interval in ms, while still (default 2000)\n" \
                         " -h or --help\t\t: * Command list\n"  				\
                         "\n"
 
 #define SERVER_PORT			1234
+
+// Shared memory segment of the local link, per port
+#define LOCAL_LINK_NAME		"/socket-connector-%u"
 #define SERVER_DEFAULT_IP  "192.168.0.23"
 
 int main(int argc, char *argv[])
 {
 	int err;
 	char ip[16] = SERVER_DEFAULT_IP;
+	int engine = TCP_ENGINE_BLOCKING;
+	sTcpProfile_t profile = {.profile = TCP_PROFILE_DEFAULT, .busyPollCpu = -1};
+	unsigned sample_rate = 100;
+	unsigned output_rate = 10;
+	unsigned stats_period = 10;
+	uint16_t port = SERVER_PORT;
+	bool local = false;
+	char local_name[32];
+	struct scheduler sched;
+#ifndef CLIENT_MODE
+	char upstream_ip[16] = {0};
+	unsigned upstream_port = SERVER_PORT;
+	unsigned batch_period = 100;
+	const char *rules_file = NULL;
+#endif
 #ifdef CLIENT_MODE
 	bool serverMode = false;
 #else
@@ -135,6 +389,7 @@ int main(int argc, char *argv[])
 		printf("Missing configuration...\n\n");
 		printf("%s", MESSAGE_HELP);
 	}
+#endif
 
 	// Validate parameters
 	for (int cont = 1; cont < argc; cont++)
@@ -148,6 +403,126 @@ int main(int argc, char *argv[])
 			(strcmp(argv[cont], "--ip") == 0)) {
 			strcpy(ip, argv[++cont]);
 		}
+		else if((strcmp(argv[cont], "-e") == 0) ||
+			(strcmp(argv[cont], "--engine") == 0)) {
+			engine = (strcmp(argv[++cont], "uring") == 0) ? TCP_ENGINE_URING : TCP_ENGINE_BLOCKING;
+		}
+		else if((strcmp(argv[cont], "-l") == 0) ||
+			(strcmp(argv[cont], "--local") == 0)) {
+			local = true;
+		}
+		else if(strcmp(argv[cont], "--low-latency") == 0) {
+			profile.profile = TCP_PROFILE_LOW_LATENCY;
+		}
+		else if(strcmp(argv[cont], "--rcvbuf") == 0) {
+			profile.rcvBufSz = atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--sndbuf") == 0) {
+			profile.sndBufSz = atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--backlog") == 0) {
+			profile.backlog = atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--busy-poll") == 0) {
+			profile.busyPollUs = atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--busy-loop") == 0) {
+			cont++;
+			profile.busyPollLoop = true;
+			profile.busyPollCpu = (strcmp(argv[cont], "any") == 0) ? -1 : atoi(argv[cont]);
+		}
+		else if((strcmp(argv[cont], "-f") == 0) ||
+			(strcmp(argv[cont], "--fusion") == 0)) {
+			cont++;
+#ifdef CLIENT_MODE
+			if (strcmp(argv[cont], "complementary") == 0)
+				m_fusion_filter = FUSION_COMPLEMENTARY;
+			else if (strcmp(argv[cont], "madgwick") == 0)
+				m_fusion_filter = FUSION_MADGWICK;
+			else if (strcmp(argv[cont], "mahony") == 0)
+				m_fusion_filter = FUSION_MAHONY;
+#endif
+		}
+		else if((strcmp(argv[cont], "-r") == 0) ||
+			(strcmp(argv[cont], "--rate") == 0)) {
+			sample_rate = (unsigned)atoi(argv[++cont]);
+		}
+		else if((strcmp(argv[cont], "-o") == 0) ||
+			(strcmp(argv[cont], "--output-rate") == 0)) {
+			output_rate = (unsigned)atoi(argv[++cont]);
+		}
+#ifndef CLIENT_MODE
+		else if(strcmp(argv[cont], "--cache-dump") == 0) {
+			return dump_cache();
+		}
+		else if((strcmp(argv[cont], "-u") == 0) ||
+			(strcmp(argv[cont], "--upstream") == 0)) {
+			if (sscanf(argv[++cont], "%15[0-9.]:%u", upstream_ip, &upstream_port) < 1 ||
+				upstream_port == 0 || upstream_port > UINT16_MAX) {
+				printf("Invalid upstream %s\n", argv[cont]);
+				exit(EXIT_FAILURE);
+			}
+			m_relay = true;
+		}
+		else if(strcmp(argv[cont], "--batch-ms") == 0) {
+			batch_period = (unsigned)atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--rules") == 0) {
+			rules_file = argv[++cont];
+		}
+#endif
+		else if((strcmp(argv[cont], "-p") == 0) ||
+			(strcmp(argv[cont], "--port") == 0)) {
+			port = (uint16_t)atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--trace") == 0) {
+			if (traceStart(argv[++cont])) {
+				printf("Tracing unavailable: %s (build with -DTRACE=TRUE)\n", argv[cont]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strcmp(argv[cont], "--log-level") == 0) {
+			int level = log_parse_level(argv[++cont]);
+
+			if (level < 0) {
+				printf("Invalid log level %s\n", argv[cont]);
+				exit(EXIT_FAILURE);
+			}
+			log_set_level(level);
+		}
+		else if(strcmp(argv[cont], "--log-rate") == 0) {
+			log_set_rate((uint32_t)atoi(argv[++cont]));
+		}
+		else if(strcmp(argv[cont], "--stats") == 0) {
+			stats_period = (unsigned)atoi(argv[++cont]);
+		}
+#ifdef CLIENT_MODE
+		else if(strcmp(argv[cont], "--euler") == 0) {
+			m_euler_output = true;
+		}
+		else if((strcmp(argv[cont], "-s") == 0) ||
+			(strcmp(argv[cont], "--sensor") == 0)) {
+			int bus = 0;
+			int addr = 0;
+			if (sscanf(argv[++cont], "%d:%i", &bus, &addr) != 2 || addr < 0 || addr > 0x7F ||
+				acquisition_add_sensor(bus, (uint8_t)addr) < 0) {
+				printf("Invalid sensor %s\n", argv[cont]);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if(strcmp(argv[cont], "--deadband-accel") == 0) {
+			parse_axes(argv[++cont], &m_report_config.deadband[0]);
+		}
+		else if(strcmp(argv[cont], "--deadband-gyro") == 0) {
+			parse_axes(argv[++cont], &m_report_config.deadband[3]);
+		}
+		else if(strcmp(argv[cont], "--min-interval") == 0) {
+			m_report_config.min_interval_ms = (uint32_t)atoi(argv[++cont]);
+		}
+		else if(strcmp(argv[cont], "--max-interval") == 0) {
+			m_report_config.max_interval_ms = (uint32_t)atoi(argv[++cont]);
+		}
+#endif
 		else
 		{
 			printf("%s", MESSAGE_HELP);
@@ -155,36 +530,137 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	// Initialize the sensor
-	mpu6050_init();
+	if (sample_rate == 0 || output_rate == 0 || output_rate > sample_rate) {
+		printf("Invalid rates: sample %u Hz, output %u Hz\n", sample_rate, output_rate);
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef CLIENT_MODE
+	if (m_report_config.min_interval_ms == 0 ||
+		m_report_config.max_interval_ms < m_report_config.min_interval_ms) {
+		printf("Invalid report intervals: min %u ms, max %u ms\n",
+			   m_report_config.min_interval_ms, m_report_config.max_interval_ms);
+		exit(EXIT_FAILURE);
+	}
+
+	if (acquisition_sensor_count() == 0)
+		acquisition_add_sensor(1, MPU6050_ADDR_AD0_LOW);
+
+	m_decimation = sample_rate / output_rate;
+	for (unsigned i = 0; i < acquisition_sensor_count(); i++) {
+		report_init(&m_sensors[i].report, &m_report_config);
+		fusion_init(&m_sensors[i].fusion, m_fusion_filter, (float)sample_rate, MPU6050_GYRO_LSB_PER_DPS);
+	}
+#else
+	// Message handlers
+	dispatch_init();
+	dispatch_register("Accel", accel_handler);
+	dispatch_register("Gyro", gyro_handler);
+	// A token right after a number must not start with e/E, i or n: "%f" would take it
+	dispatch_register("Angles", euler_handler);
+	dispatch_register("Quat", quat_handler);
+	dispatch_register("Replay", replay_handler);
+	history_init();
+	if (rules_file != NULL && rules_load(rules_file))
+		return EXIT_FAILURE;
+
+	// Latest values for local readers; the server runs without it on failure
+	if (shm_cache_create(SHM_CACHE_NAME))
+		printf("Shared memory cache %s unavailable\n", SHM_CACHE_NAME);
 #endif
 
+	// Messages of the I/O and sampling threads are formatted and written by the log thread
+	if (log_init()) {
+		printf("Failure on log thread\n");
+		return EXIT_FAILURE;
+	}
+
 	// Start the TCP layer
 	if(err = TCPInit() != ERRCODE_NO_ERROR) {
 		printf("Failure on TCP initialization: %d\n", err);
 		return EXIT_FAILURE;
 	}
 
-	// Start the TCP connection
-	if(err = TCPConnect(serverMode, &m_socketId, 
-				  ip, SERVER_PORT,
-				  receiverCallback, connectionCallback) != ERRCODE_NO_ERROR ) {
+	// Select the I/O engine, keeping the blocking one when unavailable
+	if (engine != TCP_ENGINE_BLOCKING && (err = TCPSetEngine(engine)) != ERRCODE_NO_ERROR) {
+		printf("I/O engine %d unavailable (error %d), using blocking\n", engine, err);
+	}
+
+	// Socket options, before any socket is created
+	if ((err = TCPSetProfile(&profile)) != ERRCODE_NO_ERROR) {
+		printf("Invalid socket profile (error %d)\n", err);
+		return EXIT_FAILURE;
+	}
+	if (profile.busyPollLoop && engine == TCP_ENGINE_URING)
+		printf("Busy-poll loop only applies to the blocking engine\n");
+
+	// Start the TCP connection; a local client goes through shared memory instead
+	snprintf(local_name, sizeof(local_name), LOCAL_LINK_NAME, port);
+	if (local && !serverMode)
+		err = TCPConnectLocal(false, &m_socketId, local_name, receiverCallback, connectionCallback);
+	else
+		err = TCPConnect(serverMode, &m_socketId, ip, port, receiverCallback, connectionCallback);
+	if (err != ERRCODE_NO_ERROR) {
 		printf("Failure on %s, error: %d\n", (serverMode) ? "open connection" : "connection", err);
 		return EXIT_FAILURE;
 	}
 
+	// Local producers skip the network stack: same callbacks, replies go back the same way
+	if (local && serverMode) {
+		_sSocket_t local_socket;
+
+		if ((err = TCPConnectLocal(true, &local_socket, local_name, receiverCallback, connectionCallback)) != ERRCODE_NO_ERROR)
+			printf("Local link %s unavailable, error: %d\n", local_name, err);
+	}
+
 	printf("Starting %s - socket %d\n", (serverMode) ? "server" : "client", (int)m_socketId);
 
-	// Collecting data, if applicable
-	while (true)
-	{
 #ifdef CLIENT_MODE
-		// Read sensor and validate for notification
-		// The sensor reading is only available for client!
-		send_notification();
+	// Initialize the sensors and collect data: one thread per I2C bus
+	// The sensor reading is only available for client!
+	if (acquisition_start(sample_rate, sample_sink)) {
+		printf("Failure on sensor acquisition\n");
+		return EXIT_FAILURE;
+	}
 #endif
-		sleep(2);
+
+#ifndef CLIENT_MODE
+	// Relay: server for the sensors, client of the upstream server
+	if (m_relay) {
+		if (batch_period == 0) {
+			printf("Invalid batch period\n");
+			return EXIT_FAILURE;
+		}
+		if (relay_init(upstream_ip, (uint16_t)upstream_port))
+			printf("Upstream %s:%u unreachable, retrying\n", upstream_ip, upstream_port);
 	}
+#endif
 
-	return EXIT_SUCCESS;
+	// Housekeeping jobs of the main thread, on absolute deadlines
+	if (scheduler_init(&sched)) {
+		printf("Failure on scheduler timer\n");
+		return EXIT_FAILURE;
+	}
+	if (stats_period != 0)
+		scheduler_add(&sched, "stats", SCHEDULER_PERIOD_MS(stats_period * 1000), print_stats, NULL);
+#ifndef CLIENT_MODE
+	if (m_relay)
+		scheduler_add(&sched, "flush", SCHEDULER_PERIOD_MS(batch_period), relay_flush, NULL);
+	if (rules_count() != 0)
+		scheduler_add(&sched, "rules", SCHEDULER_PERIOD_MS(RULES_PERIOD_MS), rules_run, NULL);
+#endif
+
+	// Nothing left for the main thread
+	if (sched.job_count == 0) {
+		scheduler_finish(&sched);
+		while (true)
+			pause();
+	}
+
+	err = scheduler_run(&sched);
+	scheduler_finish(&sched);
+	traceStop();
+	log_finish();
+
+	return (err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -2,17 +2,18 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <sys/ioctl.h>
 #include <stdint.h>
 
 #include "mpu6050.h"
 
-// Device BUS
-#define I2C_BUS "/dev/i2c-1"
+// Default device BUS
+#define I2C_BUS 1
 
-// Device address
-#define MPU6050_ADDR 0x68
+// Default device address
+#define MPU6050_ADDR MPU6050_ADDR_AD0_LOW
 
 // Device Registers
 #define PWR_MGMT_1   0x6B
@@ -27,98 +28,167 @@
 #define GYRO_YOUT_H  0x45
 #define GYRO_ZOUT_H  0x47
 
-// File descriptor for I2C data
-static int m_i2c_fd = 0;
+// Default device, used by the single device API
+static struct mpu6050 m_default = { .fd = -1, .addr = MPU6050_ADDR };
 
 // Read from: https://www.electronicwings.com/raspberry-pi/mpu6050-accelerometergyroscope-interfacing-with-raspberry-pi
 
-static int i2c_initilize() {
+int mpu6050_bus_open(int bus) {
+    char path[20];
+    int fd;
 
-    if ((m_i2c_fd = open(I2C_BUS, O_RDWR)) < 0) {
+    snprintf(path, sizeof(path), "/dev/i2c-%d", bus);
+    if ((fd = open(path, O_RDWR)) < 0) {
         perror("Failed to open the bus.");
+        return -1;
+    }
+    return fd;
+}
+
+void mpu6050_bus_close(int fd) {
+    close(fd);
+}
+
+static int mpu6050_config_register(const struct mpu6050 *dev, uint8_t reg, uint8_t value) {
+    uint8_t buf[2] = {reg, value};
+    struct i2c_msg msg = { .addr = dev->addr, .flags = 0, .len = 2, .buf = buf };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = &msg, .nmsgs = 1 };
+
+    if (ioctl(dev->fd, I2C_RDWR, &xfer) < 0) {
+        printf("Failed to write data to register %d of 0x%02x\n", (int)reg, dev->addr);
         return 1;
     }
     return 0;
 }
 
-static int mpu6050_config_register(uint8_t reg, uint8_t value) {
-    if (write(m_i2c_fd, &value, 1) != 1) {
-        printf("Failed to write data to register %d\n", (int)reg);
+// Register select and read in one combined transfer: the address travels in
+// each message, so devices sharing a bus descriptor do not interfere
+static int mpu6050_read_registers(const struct mpu6050 *dev, uint8_t reg, uint8_t *buf, uint16_t len) {
+    struct i2c_msg msgs[2] = {
+        { .addr = dev->addr, .flags = 0, .len = 1, .buf = &reg },
+        { .addr = dev->addr, .flags = I2C_M_RD, .len = len, .buf = buf },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+
+    if (ioctl(dev->fd, I2C_RDWR, &xfer) < 0) {
+        printf("Failed to read the data from the register %d of 0x%02x\n", (int)reg, dev->addr);
         return 1;
     }
     return 0;
 }
 
-static int mpu6050_get_data_from(uint8_t reg, uint16_t *value) {
+static int mpu6050_get_data_from(const struct mpu6050 *dev, uint8_t reg, int16_t *value) {
     uint8_t buf[2] = {0};
 
-    buf[0] = reg;
-    if (write(m_i2c_fd, buf, 1) != 1) {
-        printf("Failed to select the data register %d\n", (int)reg);
+    if (mpu6050_read_registers(dev, reg, buf, 2))
         return 1;
-    }
-    if (read(m_i2c_fd, buf, 2) != 2) {
-        printf("Failed to read the data from the register %d\n", (int)reg);
-        return 1;
-    }
     *value = (buf[0] << 8) | buf[1];
     return 0;
 }
 
-int mpu6050_init() {
-    int err;
+int mpu6050_open(struct mpu6050 *dev, int bus_fd, uint8_t addr) {
+    int err = 0;
 
-    // Initialize the BUS
-    err = i2c_initilize();
-    if (err)
-        return err;
-    
-    // Connect to device
-    if (ioctl(m_i2c_fd, I2C_SLAVE, MPU6050_ADDR) < 0) {
-        perror("Failed to connect to the sensor.");
-        return 1;
-    }
+    dev->fd = bus_fd;
+    dev->addr = addr;
 
-    err |= mpu6050_config_register(SMPLRT_DIV, 0x07);	/* Write to sample rate register */
-	err |= mpu6050_config_register(PWR_MGMT_1, 0x01);	/* Write to power management register */
-	err |= mpu6050_config_register(CONFIG, 0);		/* Write to Configuration register */
-	err |= mpu6050_config_register(GYRO_CONFIG, 24);	/* Write to Gyro Configuration register */
-	err |= mpu6050_config_register(INT_ENABLE, 0x01);	/*Write to interrupt enable register */
+    err |= mpu6050_config_register(dev, SMPLRT_DIV, 0x07);	/* Write to sample rate register */
+	err |= mpu6050_config_register(dev, PWR_MGMT_1, 0x01);	/* Write to power management register */
+	err |= mpu6050_config_register(dev, CONFIG, 0);		/* Write to Configuration register */
+	err |= mpu6050_config_register(dev, GYRO_CONFIG, 24);	/* Write to Gyro Configuration register */
+	err |= mpu6050_config_register(dev, INT_ENABLE, 0x01);	/*Write to interrupt enable register */
 
     return err;
 }
 
-void mpu6050_finish() {
-    close(m_i2c_fd);
-}
-
-int mpu6050_get_accel(float *x, float *y, float *z) {
+int mpu6050_read_accel(const struct mpu6050 *dev, float *x, float *y, float *z) {
     int err = 0;
-    uint16_t acc_x, acc_y, acc_z = 0;
-    err = mpu6050_get_data_from(ACCEL_XOUT_H, &acc_x);
-    err |= mpu6050_get_data_from(ACCEL_YOUT_H, &acc_y);
-    err |= mpu6050_get_data_from(ACCEL_ZOUT_H, &acc_z);
+    int16_t acc_x, acc_y, acc_z = 0;
+    err = mpu6050_get_data_from(dev, ACCEL_XOUT_H, &acc_x);
+    err |= mpu6050_get_data_from(dev, ACCEL_YOUT_H, &acc_y);
+    err |= mpu6050_get_data_from(dev, ACCEL_ZOUT_H, &acc_z);
 
     if(!err) {
-        *x = acc_x/16384.0;
-        *y = acc_y/16384.0;
-        *z = acc_z/16384.0;
+        const int16_t raw[3] = {acc_x, acc_y, acc_z};
+        float g[3];
+
+        mpu6050_accel_to_g(raw, g);
+        *x = g[0];
+        *y = g[1];
+        *z = g[2];
     }
 		
     return err;
 }
 
-int mpu6050_get_gyro(float *x, float *y, float *z) {
+int mpu6050_read_gyro(const struct mpu6050 *dev, float *x, float *y, float *z) {
     int err = 0;
-    uint16_t gyro_x, gyro_y, gyro_z = 0;
-    err  = mpu6050_get_data_from(GYRO_XOUT_H, &gyro_x);
-    err |= mpu6050_get_data_from(GYRO_YOUT_H, &gyro_y);
-    err |= mpu6050_get_data_from(GYRO_ZOUT_H, &gyro_z);
+    int16_t gyro_x, gyro_y, gyro_z = 0;
+    err  = mpu6050_get_data_from(dev, GYRO_XOUT_H, &gyro_x);
+    err |= mpu6050_get_data_from(dev, GYRO_YOUT_H, &gyro_y);
+    err |= mpu6050_get_data_from(dev, GYRO_ZOUT_H, &gyro_z);
 
     if(!err){
-        *x = gyro_x/131;
-		*y = gyro_y/131;
-		*z = gyro_z/131;
+        const int16_t raw[3] = {gyro_x, gyro_y, gyro_z};
+        float dps[3];
+
+        mpu6050_gyro_to_dps(raw, dps);
+        *x = dps[0];
+        *y = dps[1];
+        *z = dps[2];
     }
     return err;
 }
+
+int mpu6050_read_motion(const struct mpu6050 *dev, int16_t accel[3], int16_t gyro[3]) {
+    // ACCEL_XOUT_H .. GYRO_ZOUT_L: accel, temperature and gyro in one transfer
+    uint8_t buf[14] = {0};
+
+    if (mpu6050_read_registers(dev, ACCEL_XOUT_H, buf, sizeof(buf)))
+        return 1;
+
+    for (int i = 0; i < 3; i++) {
+        accel[i] = (int16_t)((buf[2 * i] << 8) | buf[2 * i + 1]);
+        gyro[i] = (int16_t)((buf[8 + 2 * i] << 8) | buf[8 + 2 * i + 1]);
+    }
+    return 0;
+}
+
+void mpu6050_accel_to_g(const int16_t raw[3], float g[3]) {
+    for (int i = 0; i < 3; i++)
+        g[i] = raw[i] / MPU6050_ACCEL_LSB_PER_G;
+}
+
+void mpu6050_gyro_to_dps(const int16_t raw[3], float dps[3]) {
+    for (int i = 0; i < 3; i++)
+        dps[i] = raw[i] / MPU6050_GYRO_LSB_PER_DPS;
+}
+
+int mpu6050_init() {
+    int fd;
+
+    // Initialize the BUS
+    fd = mpu6050_bus_open(I2C_BUS);
+    if (fd < 0)
+        return 1;
+
+    // Connect to device
+    return mpu6050_open(&m_default, fd, MPU6050_ADDR);
+}
+
+void mpu6050_finish() {
+    mpu6050_bus_close(m_default.fd);
+    m_default.fd = -1;
+}
+
+int mpu6050_get_accel(float *x, float *y, float *z) {
+    return mpu6050_read_accel(&m_default, x, y, z);
+}
+
+int mpu6050_get_gyro(float *x, float *y, float *z) {
+    return mpu6050_read_gyro(&m_default, x, y, z);
+}
+
+int mpu6050_get_motion(int16_t accel[3], int16_t gyro[3]) {
+    return mpu6050_read_motion(&m_default, accel, gyro);
+}
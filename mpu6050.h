@@ -9,9 +9,38 @@
 #define MPU6050_H_
 #include <stdint.h>
 
+// Sensitivity for the configured full scale ranges (+-2 g, +-2000 dps)
+#define MPU6050_ACCEL_LSB_PER_G     16384.0f
+#define MPU6050_GYRO_LSB_PER_DPS    16.4f
+
+// Device addresses, selected by the AD0 pin
+#define MPU6050_ADDR_AD0_LOW        0x68
+#define MPU6050_ADDR_AD0_HIGH       0x69
+
+// Device handle: several devices may share the descriptor of one bus
+struct mpu6050 {
+    int fd;
+    uint8_t addr;
+};
+
+// Open /dev/i2c-<bus>; returns the descriptor or -1
+int mpu6050_bus_open(int bus);
+void mpu6050_bus_close(int fd);
+// Configure the device at addr on an opened bus
+int mpu6050_open(struct mpu6050 *dev, int bus_fd, uint8_t addr);
+int mpu6050_read_accel(const struct mpu6050 *dev, float *x, float *y, float *z);
+int mpu6050_read_gyro(const struct mpu6050 *dev, float *x, float *y, float *z);
+// Burst read of accel and gyro raw counts from the same sample
+int mpu6050_read_motion(const struct mpu6050 *dev, int16_t accel[3], int16_t gyro[3]);
+// Raw counts to g and dps for the configured full scale ranges
+void mpu6050_accel_to_g(const int16_t raw[3], float g[3]);
+void mpu6050_gyro_to_dps(const int16_t raw[3], float dps[3]);
+
+// Single device on /dev/i2c-1, address 0x68
 int mpu6050_init();
 void mpu6050_finish();
 int mpu6050_get_accel(float *x, float *y, float *z);
 int mpu6050_get_gyro(float *x, float *y, float *z);
+int mpu6050_get_motion(int16_t accel[3], int16_t gyro[3]);
 
-#endif /* MPU6050_H_ */
\ No newline at end of file
+#endif /* MPU6050_H_ */
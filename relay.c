@@ -0,0 +1,213 @@
+/**
+ ******************************************************************************
+ * @file    relay.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "relay.h"
+#include "dispatch.h"
+#include "shm_cache.h"
+#include "log.h"
+#include "thread_wrapper.h"
+
+struct relay_entry {
+    float value[4];                 // Sum when averaged, latest value otherwise
+    uint32_t count;                 // Samples merged since the last flush
+};
+
+static const bool m_averaged[SHM_CACHE_CHANNELS] = {true, true, false, false};
+
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static _sSocket_t m_clients[RELAY_MAX_CLIENTS];
+static struct relay_entry m_entries[RELAY_MAX_SENSORS][SHM_CACHE_CHANNELS];
+// Entries taken by the flush, so ingest is only held for a copy
+static struct relay_entry m_pending[RELAY_MAX_SENSORS][SHM_CACHE_CHANNELS];
+static struct relay_stats m_stats;
+
+// Set by the connector thread and the connection callback, read by the flush
+static _sSocket_t m_upstream = TCP_NO_SOCKET;
+static char m_upstream_ip[16];
+static uint16_t m_upstream_port;
+static sThread_t m_connector;
+
+// Replies of the upstream server carry nothing the relay needs
+static void relay_upstream_receive(uint8_t *buffer, uint16_t len) {
+}
+
+static void relay_upstream_connection(_sSocket_t socket, bool connected) {
+    if (!connected) {
+        LOG_WARN("Upstream %s:%u disconnected\n", m_upstream_ip, m_upstream_port);
+        __atomic_store_n(&m_upstream, TCP_NO_SOCKET, __ATOMIC_RELEASE);
+    }
+}
+
+static bool relay_connect() {
+    _sSocket_t socket;
+
+    if (TCPIsConnected(__atomic_load_n(&m_upstream, __ATOMIC_ACQUIRE)))
+        return true;
+
+    if (TCPConnect(false, &socket, m_upstream_ip, m_upstream_port,
+                   relay_upstream_receive, relay_upstream_connection) != ERRCODE_NO_ERROR)
+        return false;
+
+    LOG_INFO("Upstream %s:%u connected\n", m_upstream_ip, m_upstream_port);
+    __atomic_store_n(&m_upstream, socket, __ATOMIC_RELEASE);
+    return true;
+}
+
+// The connect blocks up to its timeout on an unreachable host: kept off the scheduler thread
+static void *relay_connector(void *param) {
+    while (1) {
+        usleep(RELAY_RECONNECT_MS * 1000);
+        relay_connect();
+    }
+    return NULL;
+}
+
+int relay_init(char *ip, uint16_t port) {
+    bool connected;
+
+    for (int i = 0; i < RELAY_MAX_CLIENTS; i++)
+        m_clients[i] = TCP_NO_SOCKET;
+    memset(m_entries, 0, sizeof(m_entries));
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    snprintf(m_upstream_ip, sizeof(m_upstream_ip), "%s", ip);
+    m_upstream_port = port;
+    connected = relay_connect();
+    if (threadCreate(&m_connector, "Relay-Up", relay_connector, NULL))
+        LOG_WARN("Upstream %s:%u will not be reconnected\n", m_upstream_ip, m_upstream_port);
+    return connected ? 0 : 1;
+}
+
+void relay_client_connected(_sSocket_t socket, bool connected) {
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < RELAY_MAX_CLIENTS; i++) {
+        if (connected && m_clients[i] == TCP_NO_SOCKET) {
+            m_clients[i] = socket;
+            break;
+        }
+        if (!connected && m_clients[i] == socket) {
+            // Whatever was not flushed yet still goes out under the old ids
+            m_clients[i] = TCP_NO_SOCKET;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void relay_ingest(_sSocket_t socket, uint8_t sensor_id, int channel, const float *value,
+                  unsigned count) {
+    struct relay_entry *entry;
+    int slot = -1;
+
+    if (channel < 0 || channel >= SHM_CACHE_CHANNELS || count != shm_cache_channel_axes[channel])
+        return;
+
+    pthread_mutex_lock(&m_lock);
+    for (int i = 0; i < RELAY_MAX_CLIENTS; i++) {
+        if (m_clients[i] == socket) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0 || sensor_id >= RELAY_SENSORS_PER_CLIENT) {
+        m_stats.dropped++;
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+
+    entry = &m_entries[(slot * RELAY_SENSORS_PER_CLIENT) + sensor_id][channel];
+    if (m_averaged[channel] && entry->count != 0) {
+        for (unsigned i = 0; i < count; i++)
+            entry->value[i] += value[i];
+    } else {
+        memcpy(entry->value, value, count * sizeof(float));
+    }
+    entry->count++;
+    pthread_mutex_unlock(&m_lock);
+}
+
+// Counts go to the flush's own stats, added to m_stats in one step
+static void relay_send(_sSocket_t upstream, char *frame, int len, uint32_t messages,
+                       struct relay_stats *stats) {
+    if (len == 0)
+        return;
+    if (TCPSendData(upstream, frame, (uint16_t)len) == ERRCODE_NO_ERROR) {
+        stats->frames++;
+        stats->messages += messages;
+    } else {
+        // Connection lost or send area of the engine full: the frame is gone
+        stats->dropped += messages;
+    }
+}
+
+void relay_flush(void *param) {
+    char frame[TCP_BUFFER_SZ + 1];
+    char message[128];
+    struct relay_stats stats = {0};
+    _sSocket_t upstream = __atomic_load_n(&m_upstream, __ATOMIC_ACQUIRE);
+    uint32_t messages = 0;
+    int len = 0;
+
+    // Samples keep merging until the connector thread is back: the first frame has them all
+    if (!TCPIsConnected(upstream))
+        return;
+
+    pthread_mutex_lock(&m_lock);
+    memcpy(m_pending, m_entries, sizeof(m_pending));
+    memset(m_entries, 0, sizeof(m_entries));
+    pthread_mutex_unlock(&m_lock);
+
+    for (int sensor = 0; sensor < RELAY_MAX_SENSORS; sensor++) {
+        for (int channel = 0; channel < SHM_CACHE_CHANNELS; channel++) {
+            struct relay_entry *entry = &m_pending[sensor][channel];
+            float scale;
+            int n;
+
+            if (entry->count == 0)
+                continue;
+
+            scale = m_averaged[channel] ? (1.0f / (float)entry->count) : 1.0f;
+            n = snprintf(message, sizeof(message) - 1, "%s%c%d%c %.4f-%.4f-%.4f",
+                         shm_cache_channel_token[channel], DISPATCH_SENSOR_TAG, sensor, DISPATCH_TOKEN_SEPARATOR,
+                         entry->value[0] * scale, entry->value[1] * scale, entry->value[2] * scale);
+            if (shm_cache_channel_axes[channel] == 4)
+                n += snprintf(message + n, sizeof(message) - 1 - n, "-%.4f", entry->value[3] * scale);
+            // The stream can cut a message between two reads of the upstream server: the end
+            // of message lets it keep the first part until the rest arrives
+            message[n++] = DISPATCH_MESSAGE_END;
+
+            if (len + n > TCP_BUFFER_SZ) {
+                relay_send(upstream, frame, len, messages, &stats);
+                len = 0;
+                messages = 0;
+            }
+            memcpy(frame + len, message, n);
+            len += n;
+            messages++;
+            stats.samples += entry->count;
+        }
+    }
+    relay_send(upstream, frame, len, messages, &stats);
+
+    pthread_mutex_lock(&m_lock);
+    m_stats.frames += stats.frames;
+    m_stats.messages += stats.messages;
+    m_stats.samples += stats.samples;
+    m_stats.dropped += stats.dropped;
+    pthread_mutex_unlock(&m_lock);
+}
+
+void relay_get_stats(struct relay_stats *stats) {
+    pthread_mutex_lock(&m_lock);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * @file    relay.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef RELAY_H_
+#define RELAY_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tcp.h"
+
+// Sensor ids kept per downstream connection; each connection gets its own id range
+#define RELAY_SENSORS_PER_CLIENT    16
+#define RELAY_MAX_CLIENTS           TCP_NUMBER_CLIENTS_TO_SERVER
+#define RELAY_MAX_SENSORS           (RELAY_MAX_CLIENTS * RELAY_SENSORS_PER_CLIENT)
+
+// Wait between upstream connection attempts
+#define RELAY_RECONNECT_MS          2000
+
+struct relay_stats {
+    uint32_t frames;                // Sends upstream
+    uint32_t messages;              // Messages inside the frames
+    uint32_t samples;               // Samples merged into the messages
+    uint32_t dropped;               // Samples of unknown connections or ids out of range, and
+                                    // messages of frames that could not be sent
+};
+
+/**
+ * @brief Start the relay and its upstream connection. Must be called after
+ * the TCP layer is started. A lost or failed connection is retried every
+ * RELAY_RECONNECT_MS from a thread of the relay, never from the flush.
+ *
+ * @param ip: Upstream server address
+ * @param port: Upstream server port
+ * @return 0 on success, 1 when the upstream server could not be reached
+ */
+int relay_init(char *ip, uint16_t port);
+
+/**
+ * @brief Track a downstream connection, from the server connection callback
+ */
+void relay_client_connected(_sSocket_t socket, bool connected);
+
+/**
+ * @brief Merge a sample into the next frame. Accel and gyro are averaged
+ * over the batch window; angles and quaternions keep the latest value.
+ *
+ * @param socket: Downstream connection, from TCPGetRxSocket
+ * @param sensor_id: Sensor tag on that connection
+ * @param channel: One of enum shm_cache_channel
+ * @param value: count values, up to 4
+ */
+void relay_ingest(_sSocket_t socket, uint8_t sensor_id, int channel, const float *value,
+                  unsigned count);
+
+/**
+ * @brief Send everything merged since the last flush upstream, packing as
+ * many messages as fit in each frame. Scheduler job.
+ */
+void relay_flush(void *param);
+
+/**
+ * @brief Copy the relay counters
+ */
+void relay_get_stats(struct relay_stats *stats);
+
+#endif /* RELAY_H_ */
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file    report.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "report.h"
+
+void report_init(struct report_state *state, const struct report_config *config) {
+    memset(state, 0, sizeof(*state));
+    state->interval_ms = config->max_interval_ms;
+    // Nothing reported yet: the first sample always goes out
+    state->last_report_ms = UINT64_MAX;
+}
+
+bool report_update(struct report_state *state, const struct report_config *config,
+                   const float *values, uint64_t now_ms) {
+    bool moved = false;
+    uint64_t elapsed;
+
+    for (int i = 0; i < REPORT_CHANNELS; i++) {
+        if (fabsf(values[i] - state->last[i]) > config->deadband[i]) {
+            moved = true;
+            break;
+        }
+    }
+
+    if (state->last_report_ms == UINT64_MAX) {
+        elapsed = UINT64_MAX;
+        state->decay_mark_ms = now_ms;
+    } else {
+        elapsed = now_ms - state->last_report_ms;
+    }
+
+    if (moved) {
+        // Activity: ramp up towards the full rate, one step per fastest interval
+        if (now_ms - state->decay_mark_ms >= config->min_interval_ms) {
+            state->decay_mark_ms = now_ms;
+            state->interval_ms /= 2;
+            if (state->interval_ms < config->min_interval_ms)
+                state->interval_ms = config->min_interval_ms;
+        }
+        if (elapsed < state->interval_ms) {
+            state->suppressed++;
+            return false;
+        }
+    } else {
+        // Still: decay towards the heartbeat rate
+        if (now_ms - state->decay_mark_ms >= state->interval_ms) {
+            state->decay_mark_ms = now_ms;
+            state->interval_ms *= 2;
+            if (state->interval_ms > config->max_interval_ms)
+                state->interval_ms = config->max_interval_ms;
+        }
+        if (elapsed < config->max_interval_ms) {
+            state->suppressed++;
+            return false;
+        }
+    }
+
+    memcpy(state->last, values, sizeof(state->last));
+    state->last_report_ms = now_ms;
+    state->sent++;
+    return true;
+}
@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ * @file    report.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+// Reported channels: accel x/y/z then gyro x/y/z
+#define REPORT_CHANNELS     6
+
+struct report_config {
+    float deadband[REPORT_CHANNELS];    // Changes up to this size are noise
+    uint32_t min_interval_ms;           // Fastest reporting, while moving
+    uint32_t max_interval_ms;           // Heartbeat, while still
+};
+
+struct report_state {
+    float last[REPORT_CHANNELS];        // Last reported values
+    uint64_t last_report_ms;
+    uint64_t decay_mark_ms;             // Last time the interval was adapted
+    uint32_t interval_ms;               // Current adaptive interval
+    uint32_t sent;
+    uint32_t suppressed;
+};
+
+/**
+ * @brief Start reporting at the heartbeat rate; the first sample is reported
+ */
+void report_init(struct report_state *state, const struct report_config *config);
+
+/**
+ * @brief Decide whether a sample must be reported. While changes beyond the
+ * deadband keep coming, the interval halves every min_interval_ms (down to
+ * min_interval_ms); each quiet interval doubles it back (up to
+ * max_interval_ms). Without changes only heartbeats are reported, every
+ * max_interval_ms.
+ *
+ * @param values: Current sample, REPORT_CHANNELS values
+ * @param now_ms: Monotonic time in ms
+ * @return true when the sample must be sent
+ */
+bool report_update(struct report_state *state, const struct report_config *config,
+                   const float *values, uint64_t now_ms);
+
+#endif /* REPORT_H_ */
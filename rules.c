@@ -0,0 +1,519 @@
+/**
+ ******************************************************************************
+ * @file    rules.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rules.h"
+#include "dispatch.h"
+#include "shm_cache.h"
+#include "log.h"
+
+// Kernel width: AVX when the build allows it, SSE or NEON otherwise
+#if defined(__AVX__)
+#define RULES_VECTOR_SZ     32
+#else
+#define RULES_VECTOR_SZ     16
+#endif
+#define RULES_LANES         (RULES_VECTOR_SZ / (unsigned)sizeof(float))
+
+// Longest rule file line and alert message
+#define RULES_LINE_SZ       256
+
+typedef float rules_vf __attribute__((vector_size(RULES_VECTOR_SZ)));
+typedef int32_t rules_vi __attribute__((vector_size(RULES_VECTOR_SZ)));
+
+enum rules_metric {
+    RULES_METRIC_MAGNITUDE,         // Compared squared: no square root per sample
+    RULES_METRIC_ANY,               // Largest absolute axis
+    RULES_METRIC_AXIS,
+};
+
+struct rules_rule {
+    char name[RULES_NAME_SZ];
+    char metric_name[12];
+    int channel;
+    int metric;
+    int axis;                       // Column of RULES_METRIC_AXIS
+    bool below;
+    float threshold;
+    uint32_t duration_ms;
+    int sensor;                     // -1 for every sensor
+};
+
+// One step per rule; steps of a channel are adjacent and so are those of a metric
+struct rules_step {
+    const struct rules_rule *rule;
+    bool compute;                   // First of its metric: fills the metric column
+    float limit;                    // Threshold, squared for magnitude
+    uint32_t sensors[SHM_CACHE_MAX_SENSORS / 32];   // Streams of the rule, bitmap
+};
+
+// Condition of one rule on one stream
+struct rules_state {
+    uint32_t start_ms;              // First sample of the current run
+    uint8_t held;                   // Condition true on the last sample
+    uint8_t active;                 // Alert raised
+};
+
+// Samples of one channel, a column per field; unused axes are 0
+struct rules_column {
+    float axis[4][RULES_BATCH_SZ] __attribute__((aligned(RULES_VECTOR_SZ)));
+    uint32_t time_ms[RULES_BATCH_SZ];
+    _sSocket_t socket[RULES_BATCH_SZ];
+    uint8_t slot[RULES_BATCH_SZ];
+    uint8_t sensor[RULES_BATCH_SZ];
+};
+
+struct rules_batch {
+    uint32_t count[SHM_CACHE_CHANNELS];
+    struct rules_column columns[SHM_CACHE_CHANNELS];
+};
+
+static const char *const m_metric_names[] = {"magnitude", "any"};
+
+static struct rules_rule m_rules[RULES_MAX];
+static struct rules_step m_plan[RULES_MAX];
+static unsigned m_count = 0;
+static bool m_channel_used[SHM_CACHE_CHANNELS];
+
+// Only touched by rules_run
+static struct rules_state m_states[RULES_MAX][RULES_MAX_CLIENTS][SHM_CACHE_MAX_SENSORS];
+static float m_metric[RULES_BATCH_SZ] __attribute__((aligned(RULES_VECTOR_SZ)));
+static int32_t m_mask[RULES_BATCH_SZ] __attribute__((aligned(RULES_VECTOR_SZ)));
+static uint32_t m_events[RULES_BATCH_SZ];
+
+// Ingest fills one batch while the evaluation reads the other
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rules_batch *m_batches[2];
+static struct rules_batch *m_filling;
+static struct rules_stats m_stats;
+
+// Connection of each slot of states; a slot left by a connection is not
+// reused before rules_run has cleared it
+static _sSocket_t m_clients[RULES_MAX_CLIENTS];
+static bool m_closed[RULES_MAX_CLIENTS];
+
+static struct timespec m_epoch;
+
+static uint32_t rules_now_ms() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((int64_t)(ts.tv_sec - m_epoch.tv_sec) * 1000) +
+                      ((ts.tv_nsec - m_epoch.tv_nsec) / 1000000));
+}
+
+/*****************************************************************************/
+// Kernels, over whole vectors: columns are padded to RULES_BATCH_SZ
+
+static inline rules_vi rules_max(rules_vi a, rules_vi b) {
+    rules_vi greater = a > b;
+
+    return (a & greater) | (b & ~greater);
+}
+
+static void rules_magnitude(const struct rules_column *column, unsigned n, float *out) {
+    for (unsigned i = 0; i < n; i += RULES_LANES) {
+        rules_vf x = *(const rules_vf *)&column->axis[0][i];
+        rules_vf y = *(const rules_vf *)&column->axis[1][i];
+        rules_vf z = *(const rules_vf *)&column->axis[2][i];
+        rules_vf w = *(const rules_vf *)&column->axis[3][i];
+
+        *(rules_vf *)&out[i] = (x * x) + (y * y) + (z * z) + (w * w);
+    }
+}
+
+// Without the sign bit, floats order as integers
+static void rules_any(const struct rules_column *column, unsigned n, float *out) {
+    for (unsigned i = 0; i < n; i += RULES_LANES) {
+        rules_vi x = (rules_vi)*(const rules_vf *)&column->axis[0][i] & 0x7FFFFFFF;
+        rules_vi y = (rules_vi)*(const rules_vf *)&column->axis[1][i] & 0x7FFFFFFF;
+        rules_vi z = (rules_vi)*(const rules_vf *)&column->axis[2][i] & 0x7FFFFFFF;
+        rules_vi w = (rules_vi)*(const rules_vf *)&column->axis[3][i] & 0x7FFFFFFF;
+
+        *(rules_vf *)&out[i] = (rules_vf)rules_max(rules_max(x, y), rules_max(z, w));
+    }
+}
+
+// mask[i] is -1 where the condition holds, 0 elsewhere
+static void rules_compare(const float *metric, unsigned n, float limit, bool below, int32_t *mask) {
+    rules_vf bound = (rules_vf){0} + limit;
+
+    if (below) {
+        for (unsigned i = 0; i < n; i += RULES_LANES)
+            *(rules_vi *)&mask[i] = *(const rules_vf *)&metric[i] < bound;
+    } else {
+        for (unsigned i = 0; i < n; i += RULES_LANES)
+            *(rules_vi *)&mask[i] = *(const rules_vf *)&metric[i] > bound;
+    }
+}
+
+// Durations in sample order, with selects instead of branches: every sample
+// is written to the event list, which only advances on an alert edge
+static unsigned rules_scan(const struct rules_step *step,
+                           struct rules_state (*states)[SHM_CACHE_MAX_SENSORS],
+                           const struct rules_column *column, unsigned n) {
+    uint32_t duration = step->rule->duration_ms;
+    unsigned events = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        unsigned sensor = column->sensor[i];
+        struct rules_state *state = &states[column->slot[i]][sensor];
+        uint32_t time = column->time_ms[i];
+        uint32_t held = (uint32_t)m_mask[i] & (step->sensors[sensor / 32] >> (sensor % 32)) & 1;
+        uint32_t start = state->held ? state->start_ms : time;
+        uint32_t active = held & ((time - start) >= duration);
+
+        m_events[events] = i | (active << 31);
+        events += active ^ state->active;
+        state->start_ms = start;
+        state->held = (uint8_t)held;
+        state->active = (uint8_t)active;
+    }
+    return events;
+}
+
+/*****************************************************************************/
+// Logged always, sent only while the connection of the sample is there: the
+// socket of a closed one may already belong to a new connection
+static bool rules_alert(const struct rules_rule *rule, const struct rules_column *column,
+                        const float *metric, uint32_t event, const bool *closed) {
+    unsigned i = event & 0x7FFFFFFF;
+    bool raised = (event >> 31) != 0;
+    float value = (rule->metric == RULES_METRIC_MAGNITUDE) ? sqrtf(metric[i]) : metric[i];
+    char tag[DISPATCH_MAX_TOKEN_SZ + 1];
+    char line[RULES_LINE_SZ];
+    int n;
+
+    if (column->sensor[i] == 0)
+        snprintf(tag, sizeof(tag), "%s", shm_cache_channel_token[rule->channel]);
+    else
+        snprintf(tag, sizeof(tag), "%s%c%u", shm_cache_channel_token[rule->channel], DISPATCH_SENSOR_TAG,
+                 column->sensor[i]);
+
+    if (raised) {
+        LOG_WARN("Alert %s raised on %s: %s %.2f\n", rule->name, tag, rule->metric_name, value);
+        n = snprintf(line, sizeof(line), "<Alert %s on %s>: (%s %.2f %c %.2f for %u ms)", rule->name, tag,
+                     rule->metric_name, value, rule->below ? '<' : '>', rule->threshold, rule->duration_ms);
+    } else {
+        LOG_INFO("Alert %s cleared on %s: %s %.2f\n", rule->name, tag, rule->metric_name, value);
+        n = snprintf(line, sizeof(line), "<Alert %s cleared on %s>: (%s %.2f)", rule->name, tag,
+                     rule->metric_name, value);
+    }
+    if (!closed[column->slot[i]])
+        TCPSendData(column->socket[i], line, (uint16_t)n);
+    return raised;
+}
+
+void rules_run(void *param) {
+    struct rules_batch *batch;
+    bool closed[RULES_MAX_CLIENTS];
+    uint32_t samples = 0;
+    uint32_t raised = 0;
+    uint32_t cleared = 0;
+
+    if (m_count == 0)
+        return;
+
+    pthread_mutex_lock(&m_lock);
+    batch = m_filling;
+    m_filling = (batch == m_batches[0]) ? m_batches[1] : m_batches[0];
+    // The last samples of these connections are all in this batch
+    memcpy(closed, m_closed, sizeof(closed));
+    pthread_mutex_unlock(&m_lock);
+
+    for (unsigned s = 0; s < m_count; s++) {
+        const struct rules_step *step = &m_plan[s];
+        const struct rules_rule *rule = step->rule;
+        const struct rules_column *column = &batch->columns[rule->channel];
+        unsigned n = batch->count[rule->channel];
+        unsigned padded = (n + RULES_LANES - 1) & ~(RULES_LANES - 1);
+        const float *metric = (rule->metric == RULES_METRIC_AXIS) ? column->axis[rule->axis] : m_metric;
+        unsigned events;
+
+        if (n == 0)
+            continue;
+
+        if (step->compute && rule->metric == RULES_METRIC_MAGNITUDE)
+            rules_magnitude(column, padded, m_metric);
+        else if (step->compute)
+            rules_any(column, padded, m_metric);
+
+        rules_compare(metric, padded, step->limit, rule->below, m_mask);
+        events = rules_scan(step, m_states[s], column, n);
+        for (unsigned e = 0; e < events; e++) {
+            if (rules_alert(rule, column, metric, m_events[e], closed))
+                raised++;
+            else
+                cleared++;
+        }
+    }
+
+    for (int channel = 0; channel < SHM_CACHE_CHANNELS; channel++) {
+        samples += batch->count[channel];
+        batch->count[channel] = 0;
+    }
+
+    // Alerts still raised on a closed connection have nobody to be cleared to
+    for (int slot = 0; slot < RULES_MAX_CLIENTS; slot++) {
+        if (!closed[slot])
+            continue;
+        for (unsigned s = 0; s < m_count; s++)
+            memset(m_states[s][slot], 0, sizeof(m_states[s][slot]));
+    }
+
+    pthread_mutex_lock(&m_lock);
+    for (int slot = 0; slot < RULES_MAX_CLIENTS; slot++)
+        m_closed[slot] = m_closed[slot] && !closed[slot];
+    m_stats.batches += (samples != 0);
+    m_stats.samples += samples;
+    m_stats.raised += raised;
+    m_stats.cleared += cleared;
+    pthread_mutex_unlock(&m_lock);
+}
+
+// Slot of a connection, claiming a free one the first time (lock held); -1 when none is left
+static int rules_slot(_sSocket_t socket) {
+    int slot = -1;
+
+    for (int i = 0; i < RULES_MAX_CLIENTS; i++) {
+        if (m_clients[i] == socket)
+            return i;
+        if (slot < 0 && m_clients[i] == TCP_NO_SOCKET && !m_closed[i])
+            slot = i;
+    }
+    if (slot >= 0)
+        m_clients[slot] = socket;
+    return slot;
+}
+
+void rules_client_connected(_sSocket_t socket, bool connected) {
+    pthread_mutex_lock(&m_lock);
+    if (connected) {
+        rules_slot(socket);
+    } else {
+        for (int i = 0; i < RULES_MAX_CLIENTS; i++) {
+            if (m_clients[i] == socket) {
+                m_clients[i] = TCP_NO_SOCKET;
+                m_closed[i] = true;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+void rules_ingest(_sSocket_t socket, uint8_t sensor_id, int channel, const float *value,
+                  unsigned count) {
+    struct rules_column *column;
+    uint32_t time_ms;
+    uint32_t n;
+    int slot;
+
+    if (channel < 0 || channel >= SHM_CACHE_CHANNELS || !m_channel_used[channel] || count > 4)
+        return;
+
+    time_ms = rules_now_ms();
+    pthread_mutex_lock(&m_lock);
+    n = m_filling->count[channel];
+    // Connected while every free slot was still being cleared: claimed on its first sample
+    slot = rules_slot(socket);
+    if (n == RULES_BATCH_SZ || slot < 0) {
+        m_stats.dropped++;
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+    column = &m_filling->columns[channel];
+    for (unsigned a = 0; a < 4; a++)
+        column->axis[a][n] = (a < count) ? value[a] : 0.0f;
+    column->time_ms[n] = time_ms;
+    column->socket[n] = socket;
+    column->slot[n] = (uint8_t)slot;
+    column->sensor[n] = sensor_id;
+    m_filling->count[channel] = n + 1;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*****************************************************************************/
+// 0 on success, 1 on a bad line, -1 on a blank one
+static int rules_parse(char *line, struct rules_rule *rule) {
+    const char *separators = " \t\r\n";
+    char *token[5];
+    char *save = NULL;
+    char *key;
+    char *end;
+
+    for (int i = 0; i < 5; i++) {
+        token[i] = strtok_r((i == 0) ? line : NULL, separators, &save);
+        if (token[i] == NULL)
+            return (i == 0) ? -1 : 1;
+    }
+
+    memset(rule, 0, sizeof(*rule));
+    rule->sensor = -1;
+    if (strlen(token[0]) >= RULES_NAME_SZ)
+        return 1;
+    strcpy(rule->name, token[0]);
+
+    rule->channel = -1;
+    for (int channel = 0; channel < SHM_CACHE_CHANNELS; channel++) {
+        if (strcmp(token[1], shm_cache_channel_token[channel]) == 0)
+            rule->channel = channel;
+    }
+    if (rule->channel < 0)
+        return 1;
+
+    if (strcmp(token[2], m_metric_names[RULES_METRIC_MAGNITUDE]) == 0) {
+        rule->metric = RULES_METRIC_MAGNITUDE;
+    } else if (strcmp(token[2], m_metric_names[RULES_METRIC_ANY]) == 0) {
+        rule->metric = RULES_METRIC_ANY;
+    } else {
+        // Quaternions are sent w first
+        const char *axes = (shm_cache_channel_axes[rule->channel] == 4) ? "wxyz" : "xyz";
+        const char *axis = (strlen(token[2]) == 1) ? strchr(axes, token[2][0]) : NULL;
+
+        if (axis == NULL)
+            return 1;
+        rule->metric = RULES_METRIC_AXIS;
+        rule->axis = (int)(axis - axes);
+    }
+    snprintf(rule->metric_name, sizeof(rule->metric_name), "%s", token[2]);
+
+    if (strcmp(token[3], ">") != 0 && strcmp(token[3], "<") != 0)
+        return 1;
+    rule->below = (token[3][0] == '<');
+
+    rule->threshold = strtof(token[4], &end);
+    if (*end != '\0' || !isfinite(rule->threshold))
+        return 1;
+
+    while ((key = strtok_r(NULL, separators, &save)) != NULL) {
+        char *value = strtok_r(NULL, separators, &save);
+        long number;
+
+        if (value == NULL)
+            return 1;
+        number = strtol(value, &end, 0);
+        if (*end != '\0' || number < 0)
+            return 1;
+        if (strcmp(key, "for") == 0 && number <= INT32_MAX)
+            rule->duration_ms = (uint32_t)number;
+        else if (strcmp(key, "sensor") == 0 && number < SHM_CACHE_MAX_SENSORS)
+            rule->sensor = (int)number;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+static unsigned rules_key(const struct rules_rule *rule) {
+    return ((unsigned)rule->channel * 16) + ((unsigned)rule->metric * 4) + (unsigned)rule->axis;
+}
+
+// Plan: rules sorted by channel and metric, so each metric column is computed once per batch
+static void rules_compile() {
+    for (unsigned i = 1; i < m_count; i++) {
+        struct rules_rule rule = m_rules[i];
+        unsigned j = i;
+
+        for (; j > 0 && rules_key(&m_rules[j - 1]) > rules_key(&rule); j--)
+            m_rules[j] = m_rules[j - 1];
+        m_rules[j] = rule;
+    }
+
+    memset(m_plan, 0, sizeof(m_plan));
+    memset(m_states, 0, sizeof(m_states));
+    memset(m_channel_used, 0, sizeof(m_channel_used));
+    for (unsigned i = 0; i < m_count; i++) {
+        struct rules_step *step = &m_plan[i];
+        const struct rules_rule *rule = &m_rules[i];
+
+        step->rule = rule;
+        step->compute = (rule->metric != RULES_METRIC_AXIS) &&
+                        (i == 0 || rules_key(&m_rules[i - 1]) != rules_key(rule));
+        step->limit = rule->threshold;
+        if (rule->metric == RULES_METRIC_MAGNITUDE) {
+            // A sum of squares is never negative: -1 keeps "> negative" always and "< negative" never true
+            step->limit = (rule->threshold < 0.0f) ? -1.0f : rule->threshold * rule->threshold;
+        }
+        if (rule->sensor < 0)
+            memset(step->sensors, 0xFF, sizeof(step->sensors));
+        else
+            step->sensors[rule->sensor / 32] = 1u << (rule->sensor % 32);
+        m_channel_used[rule->channel] = true;
+    }
+}
+
+int rules_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    char line[RULES_LINE_SZ];
+    unsigned number = 0;
+    unsigned count = 0;
+
+    if (file == NULL) {
+        printf("Rules %s: cannot open\n", path);
+        return 1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (m_batches[i] == NULL) {
+            m_batches[i] = aligned_alloc(RULES_VECTOR_SZ, sizeof(struct rules_batch));
+            if (m_batches[i] == NULL) {
+                fclose(file);
+                return 1;
+            }
+        }
+        memset(m_batches[i], 0, sizeof(struct rules_batch));
+    }
+    m_filling = m_batches[0];
+    m_count = 0;
+    for (int i = 0; i < RULES_MAX_CLIENTS; i++) {
+        m_clients[i] = TCP_NO_SOCKET;
+        m_closed[i] = false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        struct rules_rule rule;
+        int err;
+
+        number++;
+        if (comment != NULL)
+            *comment = '\0';
+        err = rules_parse(line, &rule);
+        if (err > 0 || (err == 0 && count == RULES_MAX)) {
+            printf("Rules %s:%u: %s\n", path, number, (err > 0) ? "invalid rule" : "too many rules");
+            fclose(file);
+            return 1;
+        }
+        if (err == 0)
+            m_rules[count++] = rule;
+    }
+    fclose(file);
+
+    clock_gettime(CLOCK_MONOTONIC, &m_epoch);
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_count = count;
+    rules_compile();
+    return 0;
+}
+
+unsigned rules_count() {
+    return m_count;
+}
+
+void rules_get_stats(struct rules_stats *stats) {
+    pthread_mutex_lock(&m_lock);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_lock);
+}
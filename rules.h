@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+ * @file    rules.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef RULES_H_
+#define RULES_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tcp.h"
+
+// Rules in one file
+#define RULES_MAX                   64
+
+// Longest rule name
+#define RULES_NAME_SZ               24
+
+// Samples per channel between two evaluations (multiple of 8); above it they are dropped
+#define RULES_BATCH_SZ              4096
+
+// Evaluation period, in ms
+#define RULES_PERIOD_MS             10
+
+// Connections with their own alert states: TCP clients and local ones
+#define RULES_MAX_CLIENTS           (2 * TCP_NUMBER_CLIENTS_TO_SERVER)
+
+struct rules_stats {
+    uint32_t batches;               // Evaluations with samples
+    uint32_t samples;
+    uint32_t dropped;               // Samples over RULES_BATCH_SZ or of connections without a slot
+    uint32_t raised;                // Alerts raised
+    uint32_t cleared;
+};
+
+/**
+ * @brief Load the rules of a file and compile them into the evaluation plan,
+ * replacing the current one. One rule per line, '#' starts a comment:
+ *
+ *     <name> <channel> <metric> <op> <threshold> [for <ms>] [sensor <id>]
+ *
+ *     shock   Accel   magnitude  >  2.5   for 100
+ *     spin    Gyro    any        >  250
+ *     tilt    Angles  y          <  -30   for 500  sensor 3
+ *
+ * channel is a message token (Accel, Gyro, Angles, Quat). metric is the
+ * magnitude of the vector, any (largest absolute axis) or one axis: x, y, z,
+ * or w for quaternions. op is > or <. The alert is raised once the condition
+ * holds for the duration on a stream (connection, sensor and channel) and
+ * cleared on the first sample where it does not. Must be called before the
+ * server starts.
+ *
+ * @param path: Rule file
+ * @return 0 on success, 1 on failure, with the offending line printed
+ */
+int rules_load(const char *path);
+
+/**
+ * @brief Number of rules loaded
+ */
+unsigned rules_count();
+
+/**
+ * @brief Track the connections of the server: each one gets a slot of alert
+ * states, cleared by the next evaluation once it disconnects
+ */
+void rules_client_connected(_sSocket_t socket, bool connected);
+
+/**
+ * @brief Queue a sample for the next evaluation; only a copy under the lock
+ *
+ * @param socket: Connection the sample came from, alerts go back to it
+ * @param sensor_id: Sensor tag of the message
+ * @param channel: One of enum shm_cache_channel
+ * @param value: count values, up to 4
+ */
+void rules_ingest(_sSocket_t socket, uint8_t sensor_id, int channel, const float *value,
+                  unsigned count);
+
+/**
+ * @brief Evaluate the samples queued since the last run and send the alerts.
+ * Scheduler job, every RULES_PERIOD_MS.
+ */
+void rules_run(void *param);
+
+/**
+ * @brief Copy the rule counters
+ */
+void rules_get_stats(struct rules_stats *stats);
+
+#endif /* RULES_H_ */
@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @file    scheduler.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "scheduler.h"
+
+static uint64_t scheduler_now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int scheduler_arm(struct scheduler *sched, uint64_t deadline_ns) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    its.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    return timerfd_settime(sched->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+int scheduler_init(struct scheduler *sched) {
+    memset(sched, 0, sizeof(*sched));
+    sched->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    return (sched->fd < 0) ? 1 : 0;
+}
+
+int scheduler_add(struct scheduler *sched, const char *name, uint64_t period_ns,
+                  SchedulerJob_t run, void *param) {
+    struct scheduler_job *job;
+
+    if (sched->job_count >= SCHEDULER_MAX_JOBS || period_ns == 0 || run == NULL)
+        return -1;
+
+    job = &sched->jobs[sched->job_count];
+    memset(job, 0, sizeof(*job));
+    job->name = name;
+    job->run = run;
+    job->param = param;
+    job->period_ns = period_ns;
+    return (int)sched->job_count++;
+}
+
+int scheduler_run(struct scheduler *sched) {
+    uint64_t start = scheduler_now_ns();
+    uint64_t expirations;
+
+    if (sched->job_count == 0)
+        return 1;
+
+    for (unsigned i = 0; i < sched->job_count; i++)
+        sched->jobs[i].deadline_ns = start + sched->jobs[i].period_ns;
+
+    __atomic_store_n(&sched->running, true, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&sched->running, __ATOMIC_RELAXED)) {
+        uint64_t next = UINT64_MAX;
+        uint64_t now;
+
+        for (unsigned i = 0; i < sched->job_count; i++) {
+            if (sched->jobs[i].deadline_ns < next)
+                next = sched->jobs[i].deadline_ns;
+        }
+        if (scheduler_arm(sched, next) != 0)
+            return 1;
+        if (read(sched->fd, &expirations, sizeof(expirations)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return 1;
+        }
+
+        now = scheduler_now_ns();
+        for (unsigned i = 0; i < sched->job_count; i++) {
+            struct scheduler_job *job = &sched->jobs[i];
+            uint64_t late;
+            uint64_t skipped;
+
+            if (job->deadline_ns > now)
+                continue;
+
+            late = now - job->deadline_ns;
+            skipped = late / job->period_ns;
+            job->deadline_ns += (skipped + 1) * job->period_ns;
+            if (late > UINT32_MAX)
+                late = UINT32_MAX;
+
+            // Updated only here, read by scheduler_get_stats from other threads
+            __atomic_store_n(&job->stats.runs, job->stats.runs + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&job->stats.missed, job->stats.missed + skipped, __ATOMIC_RELAXED);
+            __atomic_store_n(&job->stats.jitter_sum_ns, job->stats.jitter_sum_ns + late, __ATOMIC_RELAXED);
+            if (late > job->stats.jitter_max_ns)
+                __atomic_store_n(&job->stats.jitter_max_ns, (uint32_t)late, __ATOMIC_RELAXED);
+
+            job->run(job->param);
+        }
+    }
+    return 0;
+}
+
+void scheduler_stop(struct scheduler *sched) {
+    __atomic_store_n(&sched->running, false, __ATOMIC_RELAXED);
+}
+
+void scheduler_get_stats(const struct scheduler *sched, int job, struct scheduler_stats *stats) {
+    const struct scheduler_stats *src = &sched->jobs[job].stats;
+
+    stats->runs = __atomic_load_n(&src->runs, __ATOMIC_RELAXED);
+    stats->missed = __atomic_load_n(&src->missed, __ATOMIC_RELAXED);
+    stats->jitter_sum_ns = __atomic_load_n(&src->jitter_sum_ns, __ATOMIC_RELAXED);
+    stats->jitter_max_ns = __atomic_load_n(&src->jitter_max_ns, __ATOMIC_RELAXED);
+}
+
+void scheduler_finish(struct scheduler *sched) {
+    if (sched->fd >= 0)
+        close(sched->fd);
+    sched->fd = -1;
+}
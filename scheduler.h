@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * @file    scheduler.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+// Periodic jobs sharing one scheduler thread
+#define SCHEDULER_MAX_JOBS          8
+
+// Period of a job running at hz times per second
+#define SCHEDULER_PERIOD_HZ(hz)     (1000000000ull / (hz))
+#define SCHEDULER_PERIOD_MS(ms)     ((uint64_t)(ms) * 1000000ull)
+
+typedef void (*SchedulerJob_t) (void *param);
+
+struct scheduler_stats {
+    uint64_t runs;
+    uint64_t missed;                // Deadlines skipped because a run was too late
+    uint64_t jitter_sum_ns;         // Start time minus deadline, summed over runs
+    uint32_t jitter_max_ns;
+};
+
+struct scheduler_job {
+    const char *name;
+    SchedulerJob_t run;
+    void *param;
+    uint64_t period_ns;
+    uint64_t deadline_ns;           // Absolute, CLOCK_MONOTONIC
+    struct scheduler_stats stats;
+};
+
+struct scheduler {
+    int fd;                         // timerfd armed on the earliest deadline
+    bool running;
+    unsigned job_count;
+    struct scheduler_job jobs[SCHEDULER_MAX_JOBS];
+};
+
+/**
+ * @brief Create the timer of a scheduler
+ * @return 0 on success, 1 on failure
+ */
+int scheduler_init(struct scheduler *sched);
+
+/**
+ * @brief Add a periodic job. Deadlines are absolute multiples of the period
+ * from scheduler_run, so the time a run takes never shifts the next ones.
+ *
+ * @param name: Job name, for the statistics
+ * @param period_ns: Period, e.g. SCHEDULER_PERIOD_HZ(100)
+ * @param run: Job function
+ * @param param: Parameter of the job function
+ * @return Job id, or -1 when the table is full or the period is 0
+ */
+int scheduler_add(struct scheduler *sched, const char *name, uint64_t period_ns,
+                  SchedulerJob_t run, void *param);
+
+/**
+ * @brief Run the jobs on the calling thread until scheduler_stop. A job that
+ * starts a full period late or more skips the lost deadlines, counting them
+ * as missed, instead of running back to back to catch up.
+ *
+ * @return 0 when stopped, 1 on timer failure
+ */
+int scheduler_run(struct scheduler *sched);
+
+/**
+ * @brief Make scheduler_run return after the current wake up
+ */
+void scheduler_stop(struct scheduler *sched);
+
+/**
+ * @brief Copy the statistics of a job; safe from any thread
+ */
+void scheduler_get_stats(const struct scheduler *sched, int job, struct scheduler_stats *stats);
+
+/**
+ * @brief Close the timer
+ */
+void scheduler_finish(struct scheduler *sched);
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,134 @@
+/**
+ ******************************************************************************
+ * @file    shm_cache.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_cache.h"
+
+const char *const shm_cache_channel_token[SHM_CACHE_CHANNELS] = {"Accel", "Gyro", "Angles", "Quat"};
+const uint8_t shm_cache_channel_axes[SHM_CACHE_CHANNELS] = {3, 3, 3, 4};
+
+static struct shm_cache *m_cache = NULL;
+
+int shm_cache_create(const char *name) {
+    struct shm_cache *cache;
+    int fd;
+
+    fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return 1;
+    if (ftruncate(fd, sizeof(struct shm_cache)) != 0) {
+        close(fd);
+        return 1;
+    }
+    cache = mmap(NULL, sizeof(struct shm_cache), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cache == MAP_FAILED)
+        return 1;
+
+    // Values of a previous run are stale: readers see the entries as never written
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->header.version = SHM_CACHE_VERSION;
+    cache->header.entry_size = sizeof(struct shm_cache_entry);
+    cache->header.sensors = SHM_CACHE_MAX_SENSORS;
+    cache->header.channels = SHM_CACHE_CHANNELS;
+    __atomic_store_n(&cache->header.magic, SHM_CACHE_MAGIC, __ATOMIC_RELEASE);
+
+    m_cache = cache;
+    return 0;
+}
+
+void shm_cache_publish(uint8_t sensor_id, int channel, const float *value, const float *delta,
+                       unsigned count) {
+    struct shm_cache_entry *entry;
+    struct timespec ts;
+    uint32_t seq;
+
+    if (m_cache == NULL || sensor_id >= SHM_CACHE_MAX_SENSORS ||
+        channel < 0 || channel >= SHM_CACHE_CHANNELS || count > 4)
+        return;
+
+    entry = &m_cache->entries[sensor_id][channel];
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    // Taking the seqlock: even to odd, also serializing writers of this entry
+    seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+    do {
+        while (seq & 1)
+            seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    // Odd sequence visible before any of the data changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    entry->updates++;
+    entry->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    memcpy(entry->value, value, count * sizeof(float));
+    if (delta != NULL)
+        memcpy(entry->delta, delta, count * sizeof(float));
+    else
+        memset(entry->delta, 0, count * sizeof(float));
+
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+const struct shm_cache *shm_cache_attach(const char *name) {
+    const struct shm_cache *cache;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    cache = mmap(NULL, sizeof(struct shm_cache), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cache == MAP_FAILED)
+        return NULL;
+
+    if (__atomic_load_n(&cache->header.magic, __ATOMIC_ACQUIRE) != SHM_CACHE_MAGIC ||
+        cache->header.version != SHM_CACHE_VERSION ||
+        cache->header.entry_size != sizeof(struct shm_cache_entry)) {
+        munmap((void *)cache, sizeof(struct shm_cache));
+        return NULL;
+    }
+    return cache;
+}
+
+int shm_cache_read(const struct shm_cache *cache, uint8_t sensor_id, int channel,
+                   struct shm_cache_sample *sample) {
+    const struct shm_cache_entry *entry;
+    uint32_t begin, end = 0;
+
+    if (sensor_id >= SHM_CACHE_MAX_SENSORS || channel < 0 || channel >= SHM_CACHE_CHANNELS)
+        return 1;
+
+    entry = &cache->entries[sensor_id][channel];
+    do {
+        begin = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue;
+
+        sample->updates = entry->updates;
+        sample->timestamp_ns = entry->timestamp_ns;
+        memcpy(sample->value, entry->value, sizeof(sample->value));
+        memcpy(sample->delta, entry->delta, sizeof(sample->delta));
+
+        // The copies above must complete before the sequence is checked again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || begin != end);
+
+    return (begin == 0) ? 1 : 0;
+}
+
+void shm_cache_detach(const struct shm_cache *cache) {
+    munmap((void *)cache, sizeof(struct shm_cache));
+}
@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * @file    shm_cache.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef SHM_CACHE_H_
+#define SHM_CACHE_H_
+#include <stdint.h>
+
+// POSIX shared memory object with the latest value of every sensor
+#define SHM_CACHE_NAME          "/socket-connector"
+#define SHM_CACHE_MAGIC         0x53434143u     // "CACS"
+#define SHM_CACHE_VERSION       1
+#define SHM_CACHE_MAX_SENSORS   256             // Every sensor tag
+#define SHM_CACHE_LINE_SZ       64
+
+enum shm_cache_channel {
+    SHM_CACHE_ACCEL,
+    SHM_CACHE_GYRO,
+    SHM_CACHE_ANGLES,
+    SHM_CACHE_QUAT,
+    SHM_CACHE_CHANNELS,
+};
+
+// Message token and number of values of each channel
+extern const char *const shm_cache_channel_token[SHM_CACHE_CHANNELS];
+extern const uint8_t shm_cache_channel_axes[SHM_CACHE_CHANNELS];
+
+// One cache line per entry, so writers of different entries never share a line
+struct shm_cache_entry {
+    uint32_t seq;                   // Seqlock: odd while the entry is written
+    uint32_t updates;
+    uint64_t timestamp_ns;          // CLOCK_MONOTONIC of the last update
+    float value[4];                 // x, y, z (w, x, y, z for quaternions)
+    float delta[4];                 // Change from the previous value
+} __attribute__((aligned(SHM_CACHE_LINE_SZ)));
+
+struct shm_cache_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint16_t sensors;
+    uint16_t channels;
+} __attribute__((aligned(SHM_CACHE_LINE_SZ)));
+
+struct shm_cache {
+    struct shm_cache_header header;
+    struct shm_cache_entry entries[SHM_CACHE_MAX_SENSORS][SHM_CACHE_CHANNELS];
+};
+
+// Consistent copy of an entry
+struct shm_cache_sample {
+    uint32_t updates;
+    uint64_t timestamp_ns;
+    float value[4];
+    float delta[4];
+};
+
+/**
+ * @brief Create (or reset) the shared memory object and map it for writing
+ * @param name: Object name, e.g. SHM_CACHE_NAME
+ * @return 0 on success, 1 on failure
+ */
+int shm_cache_create(const char *name);
+
+/**
+ * @brief Publish the latest value of a sensor channel. Never blocks on
+ * readers; concurrent writers of the same entry are serialized on its
+ * seqlock. Does nothing when the cache was not created.
+ *
+ * @param sensor_id: Sensor tag of the message
+ * @param channel: One of enum shm_cache_channel
+ * @param value: count values
+ * @param delta: count deltas, or NULL
+ * @param count: Up to 4
+ */
+void shm_cache_publish(uint8_t sensor_id, int channel, const float *value, const float *delta,
+                       unsigned count);
+
+/**
+ * @brief Map an existing cache read-only, from any local process
+ * @return The cache, or NULL when missing or of another version
+ */
+const struct shm_cache *shm_cache_attach(const char *name);
+
+/**
+ * @brief Copy an entry without locking: retried while a writer is inside it
+ * @return 0 on success, 1 when the entry is out of range or never written
+ */
+int shm_cache_read(const struct shm_cache *cache, uint8_t sensor_id, int channel,
+                   struct shm_cache_sample *sample);
+
+/**
+ * @brief Unmap a cache returned by shm_cache_attach
+ */
+void shm_cache_detach(const struct shm_cache *cache);
+
+#endif /* SHM_CACHE_H_ */
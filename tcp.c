@@ -5,6 +5,8 @@
  ******************************************************************************
  */
 
+#define _GNU_SOURCE		// pthread_setaffinity_np
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,14 +14,22 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
 
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 
 #include "tcp.h"
+#include "tcp_uring.h"
+#include "tcp_shm.h"
+#include "buffer_pool.h"
 #include "thread_wrapper.h"
+#include "trace.h"
 
 /**
  * @note para checar o listen, via terminal linux:
@@ -33,8 +43,8 @@
 // Periodo para rodar a thread de conexao (server) em ms.
 #define TCP_CON_THREAD_REFRESH_PERIOD		(1000)
 
-// Define o maximo de conexões pendentes
-#define TCP_MAX_PENDING_CONNECTIONS			TCP_NUMBER_CLIENT_SOCKET
+// Define o maximo de conexões pendentes (padrao, sem perfil)
+#define TCP_MAX_PENDING_CONNECTIONS			TCP_NUMBER_CLIENTS_TO_SERVER
 
 /******************************************************************************/
 // Controle de estados de conexao (caso server)
@@ -51,7 +61,6 @@ struct _sSocketClient
 	enum _eTcpConnectionState eState;
 	pthread_t xthrRecvID;
 	bool bKillThreadRx;
-	uint8_t buffer[TCP_BUFFER_SZ];
 	CallbackReceiverTcp_t vCallbackTCPRx;
 };
 
@@ -71,7 +80,6 @@ struct _sConnection
 	enum _eTcpConnectionState eState;
 	sThread_t xthrRecvID;
 	bool bKillThreadRx;
-	uint8_t buffer[TCP_BUFFER_SZ];
 	CallbackReceiverTcp_t vCallbackTCPRx;
 	CallbackConnection_t vCallbackTCPConnect;
 	struct _sSocketServer server;
@@ -81,8 +89,13 @@ struct _sConnection
 struct {
 	struct _sConnection sConnection[TCP_NUMBER_CONNECTIONS];
     uint8_t counter;
+    int engine;
+    sTcpProfile_t profile;
 } m_sTcpWork;
 
+// Socket cujos dados estao sendo entregues ao callback pela thread corrente
+static _Thread_local _sSocket_t m_rxSocket = TCP_NO_SOCKET;
+
 /*****************************************************************************/
 /**
  * @brief Validacao para o proximo index valido para socket
@@ -98,6 +111,23 @@ static int _TCPGetNextFreePosition(void);
  */
 static struct _sConnection* _TCPGetSocketStructPointer(_sSocket_t socketId);
 
+/**
+ * @brief Registro de um client aceito pelo servidor e inicio da sua recepcao
+ *
+ * @param psConnection - Conexao do servidor
+ * @param socket - Socket do client aceito
+ * @return Codigo de erro
+ */
+static int _TCPAcceptClient(struct _sConnection* psConnection, _sSocket_t socket);
+
+/**
+ * @brief Aplicacao do perfil em um socket
+ *
+ * @param socket - Socket a configurar
+ * @param connected - false para o socket de listen (apenas buffers, herdados pelos aceitos)
+ */
+static void _TCPApplyProfile(_sSocket_t socket, bool connected);
+
 /**
  * @brief Thread de conexao (server mode)
  *
@@ -110,6 +140,12 @@ void* _TCPThreadServer(void *arg);
  * @param arg
  */
 void* _TCPThreadRcve(void *arg);
+/**
+ * @brief Thread de recepcao em laco de busy-poll, sem bloquear no kernel
+ *
+ * @param arg
+ */
+void* _TCPThreadRcveBusy(void *arg);
 
 
 /*****************************************************************************/
@@ -123,10 +159,65 @@ int TCPInit(void)
 	{
 		m_sTcpWork.sConnection[i].handle = TCP_NO_SOCKET;
 	}
+	m_sTcpWork.profile.busyPollCpu = -1;
+
+	return ERRCODE_NO_ERROR;
+}
+
+//***************************************************************************
+int TCPSetProfile(const sTcpProfile_t *profile)
+{
+	if((profile == NULL) || (m_sTcpWork.counter))
+	{
+		return ERRCODE_PARAMETRO_INVALIDO;
+	}
+
+	if((profile->profile != TCP_PROFILE_DEFAULT) && (profile->profile != TCP_PROFILE_LOW_LATENCY))
+	{
+		return ERRCODE_PARAMETRO_INVALIDO;
+	}
 
+	if((profile->rcvBufSz < 0) || (profile->sndBufSz < 0) || (profile->backlog < 0) ||
+		(profile->busyPollUs < 0))
+	{
+		return ERRCODE_PARAMETRO_INVALIDO;
+	}
+
+	m_sTcpWork.profile = *profile;
 	return ERRCODE_NO_ERROR;
 }
 
+//***************************************************************************
+int TCPSetEngine(int engine)
+{
+	int ret;
+
+	if(m_sTcpWork.counter)
+	{
+		// Sockets ja abertos continuam no motor em que foram criados
+		return ERRCODE_PARAMETRO_INVALIDO;
+	}
+
+	switch(engine)
+	{
+	case TCP_ENGINE_BLOCKING:
+		ret = ERRCODE_NO_ERROR;
+		break;
+	case TCP_ENGINE_URING:
+		ret = TCPUringInit();
+		break;
+	default:
+		ret = ERRCODE_PARAMETRO_INVALIDO;
+		break;
+	}
+
+	if(ret == ERRCODE_NO_ERROR)
+	{
+		m_sTcpWork.engine = engine;
+	}
+	return ret;
+}
+
 //***************************************************************************
 int TCPConnect(bool serverMode, _sSocket_t * socketId, char *ip, uint16_t port,
 				   CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb)
@@ -187,7 +278,9 @@ int TCPConnect(bool serverMode, _sSocket_t * socketId, char *ip, uint16_t port,
 			}
 		}
 
-		if(listen(*socketId, TCP_MAX_PENDING_CONNECTIONS))
+		_TCPApplyProfile(*socketId, false);
+		if(listen(*socketId, (m_sTcpWork.profile.backlog) ? m_sTcpWork.profile.backlog :
+													TCP_MAX_PENDING_CONNECTIONS))
 		{
 			printf("Listen failed");
 			ret =  ERRCODE_TCP_LISTEN_FAILED;
@@ -199,10 +292,17 @@ int TCPConnect(bool serverMode, _sSocket_t * socketId, char *ip, uint16_t port,
 		m_sTcpWork.sConnection[idx].vCallbackTCPConnect = connectionCb;
 		m_sTcpWork.sConnection[idx].eState = _E_TCP_CONNECTED;
 
-		ret = threadCreate(&m_sTcpWork.sConnection[idx].server.xthrServerID,
-							"TCP-Server",
-							_TCPThreadServer,
-							&m_sTcpWork.sConnection[idx]);
+		if(m_sTcpWork.engine == TCP_ENGINE_URING)
+		{
+			ret = TCPUringListen(*socketId);
+		}
+		else
+		{
+			ret = threadCreate(&m_sTcpWork.sConnection[idx].server.xthrServerID,
+								"TCP-Server",
+								_TCPThreadServer,
+								&m_sTcpWork.sConnection[idx]);
+		}
 		if(ret)
 		{
 			printf("Error thread Rcve");
@@ -224,6 +324,9 @@ int TCPConnect(bool serverMode, _sSocket_t * socketId, char *ip, uint16_t port,
 		server.sin_family 	   = AF_INET;
 		server.sin_port   	   = htons( port );
 
+		// Buffers antes do connect, para valerem na negociacao da janela
+		_TCPApplyProfile(*socketId, true);
+
 		if (connect(*socketId , (struct sockaddr *)&server , sizeof(server)) < 0)
 		{
 			printf("Connect error..\n");
@@ -237,10 +340,17 @@ int TCPConnect(bool serverMode, _sSocket_t * socketId, char *ip, uint16_t port,
 		m_sTcpWork.sConnection[idx].vCallbackTCPRx = receiveCb;
 		m_sTcpWork.sConnection[idx].eState = _E_TCP_CONNECTED;
 
-		ret = threadCreate(&m_sTcpWork.sConnection[idx].xthrRecvID,
-							"Tcp-Rcve",
-							_TCPThreadRcve,
-							&m_sTcpWork.sConnection[idx].handle);
+		if(m_sTcpWork.engine == TCP_ENGINE_URING)
+		{
+			ret = TCPUringWatch(*socketId);
+		}
+		else
+		{
+			ret = threadCreate(&m_sTcpWork.sConnection[idx].xthrRecvID,
+								"Tcp-Rcve",
+								(m_sTcpWork.profile.busyPollLoop) ? _TCPThreadRcveBusy : _TCPThreadRcve,
+								&m_sTcpWork.sConnection[idx].handle);
+		}
 		if(ret)
 		{
 			printf("Erro thread Rcve - client\n");
@@ -259,11 +369,23 @@ exit:
 	return ret;
 }
 //***************************************************************************
+int TCPConnectLocal(bool serverMode, _sSocket_t *socketId, const char *name,
+					CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb)
+{
+	return TCPShmConnect(serverMode, socketId, name, receiveCb, connectionCb);
+}
+//***************************************************************************
 int TCPDisconnect(_sSocket_t socketId)
 {
 	int ret;
 	struct _sConnection* psConnection;
 
+	if(TCP_IS_LOCAL_SOCKET(socketId))
+	{
+		TRACE(TRACE_EV_DISCONNECT, socketId, 0);
+		return TCPShmDisconnect(socketId);
+	}
+
 	// Procura o socket na estrutura de trabalho
 	psConnection = _TCPGetSocketStructPointer(socketId);
     if(psConnection == NULL)
@@ -271,12 +393,18 @@ int TCPDisconnect(_sSocket_t socketId)
     	ret = ERRCODE_PARAMETRO_INVALIDO;
     	goto error;
     }
+	TRACE(TRACE_EV_DISCONNECT, socketId, 0);
 
     if(psConnection->vCallbackTCPConnect != NULL)
     {
     	(*psConnection->vCallbackTCPConnect)(socketId, false);
     }
 
+	if(m_sTcpWork.engine == TCP_ENGINE_URING)
+	{
+		TCPUringForget(socketId);
+	}
+
 	ret = shutdown(socketId, SHUT_RDWR );
 	ret |= close(socketId);
 	if(ret)
@@ -338,6 +466,12 @@ bool TCPIsConnected (_sSocket_t  socketId)
 		goto exit;
 	}
 
+	if(TCP_IS_LOCAL_SOCKET(socketId))
+	{
+		state = TCPShmIsConnected(socketId);
+		goto exit;
+	}
+
 	// Procura o socket na estrutura de trabalho
 	psConnection = _TCPGetSocketStructPointer(socketId);
     if(psConnection == NULL)
@@ -357,6 +491,13 @@ int TCPSendData(_sSocket_t socketId, char *p_pbuffer, uint16_t p_u16Len)
 	int ret = ERRCODE_NO_ERROR;
 	struct _sConnection* psConnection;
 
+	if(TCP_IS_LOCAL_SOCKET(socketId))
+	{
+		// Copia direto para o anel da conexao local, sem passar pelo kernel
+		TRACE(TRACE_EV_SEND, socketId, p_u16Len);
+		return TCPShmSend(socketId, p_pbuffer, p_u16Len);
+	}
+
 	// Procura o socket na estrutura de trabalho
 	psConnection = _TCPGetSocketStructPointer(socketId);
     if(psConnection == NULL)
@@ -364,15 +505,29 @@ int TCPSendData(_sSocket_t socketId, char *p_pbuffer, uint16_t p_u16Len)
     	return ERRCODE_PARAMETRO_INVALIDO;
     }
 
+	TRACE(TRACE_EV_SEND, socketId, p_u16Len);
+	if(m_sTcpWork.engine == TCP_ENGINE_URING)
+	{
+		// Copia para a area registrada; o envio e agrupado pelo motor
+		return TCPUringSend(socketId, p_pbuffer, p_u16Len);
+	}
+
 	wr = write(socketId, p_pbuffer, (size_t)p_u16Len);
 	if(wr != p_u16Len)
 	{
+		TRACE(TRACE_EV_SHORT_WRITE, socketId, wr);
 		ret = ERRCODE_TCP_WRITE_FAILED;
 	}
 
 	return ret;
 }
 
+//***************************************************************************
+_sSocket_t TCPGetRxSocket(void)
+{
+	return m_rxSocket;
+}
+
 /******************************************************************************
  * Local Functions code
  *****************************************************************************/
@@ -390,31 +545,20 @@ void* _TCPThreadServer(void *param)
 		socket  = accept(psConnection->handle, (struct sockaddr *)&client, (socklen_t*)&connection);
 		if (socket > 0)
 		{
-			if(psConnection->server.clientCount >= TCP_NUMBER_CLIENTS_TO_SERVER)
+			ret = _TCPAcceptClient(psConnection, socket);
+			if(ret == ERRCODE_TCP_NO_SPACE_FOR_CONNECTION)
 			{
 				shutdown(socket, SHUT_RDWR);
 				close(socket);
-				sleep(TCP_CON_THREAD_REFRESH_PERIOD);
+				usleep(TCP_CON_THREAD_REFRESH_PERIOD * 1000);
 				continue;
 			}
 
-			psConnection->server.client[psConnection->server.clientCount].handle = socket;
-			psConnection->server.client[psConnection->server.clientCount].eState = _E_TCP_CONNECTED;
-			ret = threadCreate(&psConnection->xthrRecvID,
-								"TCP-Rcve",
-								_TCPThreadRcve,
-								&psConnection->server.client[psConnection->server.clientCount].handle);
-
 			if(ret)
 			{
 				printf("Erro thread connect - server");
 				goto exit;
 			}
-
-			if(psConnection->vCallbackTCPConnect != NULL)
-				(*psConnection->vCallbackTCPConnect)(psConnection->server.client[psConnection->server.clientCount].handle, true);
-			psConnection->server.clientCount++;
-			m_sTcpWork.counter++;
 		}
 		else
 			goto exit;
@@ -433,37 +577,191 @@ void* _TCPThreadServer(void *param)
 //***************************************************************************
 void* _TCPThreadRcve(void *param)
 {
-	_sSocket_t *psocket = (_sSocket_t*)param;;
+	_sSocket_t *psocket = (_sSocket_t*)param;
 	struct _sConnection* psConnection;
+	struct pollfd pfd;
+	uint8_t *buffer;
+	uint16_t capacity;
+	int pending;
 	int rd;
 
 	do
 	{
+		// Aguarda dados sem manter buffer reservado
+		pfd.fd = *psocket;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if((poll(&pfd, 1, -1) < 0) && (errno == EINTR))
+			continue;
+
+		// Empresta do pool da thread apenas o necessario para o que esta disponivel
+		if(ioctl(*psocket, FIONREAD, &pending) < 0)
+			pending = TCP_BUFFER_SZ;
+		else if(pending <= 0)
+			pending = 1;
+		else if(pending > TCP_BUFFER_SZ)
+			pending = TCP_BUFFER_SZ;
+
+		buffer = bufferPoolGet((uint16_t)(pending + 1), &capacity);
+		if(buffer == NULL)
+		{
+			printf("No buffer for socket %d\n", *psocket);
+			rd = -1;
+		}
+		else
+		{
+			// Reserva um byte para o terminador nulo esperado pelos callbacks de texto
+			rd = read(*psocket, buffer, (capacity > TCP_BUFFER_SZ) ? TCP_BUFFER_SZ : (capacity - 1));
+			TRACE(TRACE_EV_READ, *psocket, rd);
+			if(rd >= 0)
+				buffer[rd] = 0;
+		}
+
+		if((rd > 0) && (m_sTcpWork.profile.profile == TCP_PROFILE_LOW_LATENCY))
+		{
+			// TCP_QUICKACK nao e permanente: o kernel o desfaz e precisa ser rearmado a cada leitura
+			int on = 1;
+			setsockopt(*psocket, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+		}
+
 		// Procura o socket na estrutura de trabalho
 		psConnection = _TCPGetSocketStructPointer(*psocket);
-	    if(psConnection != NULL)
-	    {
-			rd = read(*psocket, psConnection->buffer , TCP_BUFFER_SZ);
-			if(rd > 0)
-			{
-				(*psConnection->vCallbackTCPRx)(psConnection->buffer, rd);
-			}
-			else
-			{
-				if(psConnection == NULL)
-				{
-					psConnection = NULL;
-				}
-				// Ao ler ZERO, indicio de que tivemos uma desconexao
-				TCPDisconnect(*psocket);
-				threadExit();
-			}
-	    }
+		if((rd > 0) && (psConnection != NULL))
+		{
+			m_rxSocket = *psocket;
+			TRACE(TRACE_EV_CALLBACK_ENTER, *psocket, rd);
+			(*psConnection->vCallbackTCPRx)(buffer, rd);
+			TRACE(TRACE_EV_CALLBACK_EXIT, *psocket, 0);
+			m_rxSocket = TCP_NO_SOCKET;
+		}
+		bufferPoolRelease(buffer);
+
+		if(psConnection == NULL)
+		{
+			// Socket ja desconectado por outra thread
+			threadExit();
+		}
+		if(rd <= 0)
+		{
+			// Ao ler ZERO, indicio de que tivemos uma desconexao
+			TCPDisconnect(*psocket);
+			threadExit();
+		}
+	} while(1);
+
+	return NULL;
+}
+
+//***************************************************************************
+void* _TCPThreadRcveBusy(void *param)
+{
+	_sSocket_t *psocket = (_sSocket_t*)param;
+	_sSocket_t socket = *psocket;
+	struct _sConnection* psConnection;
+	uint8_t *buffer;
+	uint16_t capacity;
+	int rd;
+	int on = 1;
+
+	if(m_sTcpWork.profile.busyPollCpu >= 0)
+	{
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(m_sTcpWork.profile.busyPollCpu, &cpus);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus))
+			printf("Affinity to CPU %d failed\n", m_sTcpWork.profile.busyPollCpu);
+	}
+
+	// O laco nunca dorme: o buffer fica reservado por toda a conexao
+	buffer = bufferPoolGet(TCP_BUFFER_SZ + 1, &capacity);
+	if(buffer == NULL)
+	{
+		printf("No buffer for socket %d\n", socket);
+		TCPDisconnect(socket);
+		threadExit();
+	}
+
+	do
+	{
+		rd = recv(socket, buffer, TCP_BUFFER_SZ, MSG_DONTWAIT);
+		if((rd < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+		{
+			// Sem dados: verifica se o socket foi fechado por outra thread
+			if(_TCPGetSocketStructPointer(socket) == NULL)
+				break;
+			continue;
+		}
+
+		TRACE(TRACE_EV_READ, socket, rd);
+		psConnection = _TCPGetSocketStructPointer(socket);
+		if((rd > 0) && (psConnection != NULL))
+		{
+			buffer[rd] = 0;
+			if(m_sTcpWork.profile.profile == TCP_PROFILE_LOW_LATENCY)
+				setsockopt(socket, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+
+			m_rxSocket = socket;
+			TRACE(TRACE_EV_CALLBACK_ENTER, socket, rd);
+			(*psConnection->vCallbackTCPRx)(buffer, rd);
+			TRACE(TRACE_EV_CALLBACK_EXIT, socket, 0);
+			m_rxSocket = TCP_NO_SOCKET;
+			continue;
+		}
+
+		if(psConnection != NULL)
+		{
+			// Ao ler ZERO (ou erro), indicio de que tivemos uma desconexao
+			TCPDisconnect(socket);
+		}
+		break;
 	} while(1);
 
+	bufferPoolRelease(buffer);
+	threadExit();
+
 	return NULL;
 }
 
+//***************************************************************************
+static void _TCPApplyProfile(_sSocket_t socket, bool connected)
+{
+	sTcpProfile_t *psProfile = &m_sTcpWork.profile;
+	int on = 1;
+
+	if((psProfile->rcvBufSz) &&
+		setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &psProfile->rcvBufSz, sizeof(int)))
+	{
+		printf("SO_RCVBUF %d failed on socket %d\n", psProfile->rcvBufSz, socket);
+	}
+	if((psProfile->sndBufSz) &&
+		setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &psProfile->sndBufSz, sizeof(int)))
+	{
+		printf("SO_SNDBUF %d failed on socket %d\n", psProfile->sndBufSz, socket);
+	}
+
+	if(!connected)
+		return;
+
+#ifdef SO_BUSY_POLL
+	if((psProfile->busyPollUs) &&
+		setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &psProfile->busyPollUs, sizeof(int)))
+	{
+		printf("SO_BUSY_POLL %d failed on socket %d\n", psProfile->busyPollUs, socket);
+	}
+#endif
+
+	if(psProfile->profile == TCP_PROFILE_LOW_LATENCY)
+	{
+		// Escritas pequenas seguidas (Accel/Gyro) nao esperam o ACK da anterior
+		if(setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) ||
+			setsockopt(socket, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on)))
+		{
+			printf("Low latency options failed on socket %d\n", socket);
+		}
+	}
+}
+
 //***************************************************************************
 static int _TCPGetNextFreePosition(void)
 {
@@ -500,7 +798,7 @@ static struct _sConnection* _TCPGetSocketStructPointer(_sSocket_t socketId)
     			int j;
     			for(j = 0; j < TCP_NUMBER_CLIENTS_TO_SERVER; j++)
     			{
-    				if(m_sTcpWork.sConnection[j].server.client[j].handle == socketId)
+    				if(m_sTcpWork.sConnection[i].server.client[j].handle == socketId)
     				{
     					 return &m_sTcpWork.sConnection[i];
     				}
@@ -517,3 +815,111 @@ static struct _sConnection* _TCPGetSocketStructPointer(_sSocket_t socketId)
     }
    return NULL;
 }
+//***************************************************************************
+static int _TCPAcceptClient(struct _sConnection* psConnection, _sSocket_t socket)
+{
+	struct _sSocketClient *psClient = NULL;
+	int i;
+	int ret;
+
+	if(psConnection->server.clientCount >= TCP_NUMBER_CLIENTS_TO_SERVER)
+		return ERRCODE_TCP_NO_SPACE_FOR_CONNECTION;
+
+	// Qualquer posicao pode ter sido liberada por uma desconexao
+	for(i = 0; i < TCP_NUMBER_CLIENTS_TO_SERVER; i++)
+	{
+		if(psConnection->server.client[i].eState == _E_TCP_DISCONNECTED)
+		{
+			psClient = &psConnection->server.client[i];
+			break;
+		}
+	}
+	if(psClient == NULL)
+		return ERRCODE_TCP_NO_SPACE_FOR_CONNECTION;
+
+	_TCPApplyProfile(socket, true);
+	psClient->handle = socket;
+	psClient->eState = _E_TCP_CONNECTED;
+	if(m_sTcpWork.engine == TCP_ENGINE_URING)
+	{
+		ret = TCPUringWatch(socket);
+	}
+	else
+	{
+		ret = threadCreate(&psConnection->xthrRecvID,
+							"TCP-Rcve",
+							(m_sTcpWork.profile.busyPollLoop) ? _TCPThreadRcveBusy : _TCPThreadRcve,
+							&psClient->handle);
+	}
+	if(ret)
+	{
+		psClient->handle = TCP_NO_SOCKET;
+		psClient->eState = _E_TCP_DISCONNECTED;
+		return ERRCODE_OS_FAILURE;
+	}
+
+	if(psConnection->vCallbackTCPConnect != NULL)
+		(*psConnection->vCallbackTCPConnect)(socket, true);
+	psConnection->server.clientCount++;
+	TRACE(TRACE_EV_ACCEPT, socket, psConnection->server.clientCount);
+	m_sTcpWork.counter++;
+
+	return ERRCODE_NO_ERROR;
+}
+
+/******************************************************************************
+ * Ganchos do motor io_uring
+ *****************************************************************************/
+bool _TCPOnAccept(_sSocket_t listenSocket, _sSocket_t socket)
+{
+	struct _sConnection* psConnection;
+
+	psConnection = _TCPGetSocketStructPointer(listenSocket);
+	if(psConnection == NULL)
+		return false;
+
+	return (_TCPAcceptClient(psConnection, socket) == ERRCODE_NO_ERROR);
+}
+//***************************************************************************
+void _TCPOnReceive(_sSocket_t socket, uint8_t *buffer, uint16_t len)
+{
+	struct _sConnection* psConnection;
+
+	psConnection = _TCPGetSocketStructPointer(socket);
+	if((psConnection != NULL) && (psConnection->vCallbackTCPRx != NULL))
+	{
+		if(m_sTcpWork.profile.profile == TCP_PROFILE_LOW_LATENCY)
+		{
+			int on = 1;
+			setsockopt(socket, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+		}
+
+		TRACE(TRACE_EV_READ, socket, len);
+		m_rxSocket = socket;
+		TRACE(TRACE_EV_CALLBACK_ENTER, socket, len);
+		(*psConnection->vCallbackTCPRx)(buffer, len);
+		TRACE(TRACE_EV_CALLBACK_EXIT, socket, 0);
+		m_rxSocket = TCP_NO_SOCKET;
+	}
+}
+//***************************************************************************
+void _TCPOnClosed(_sSocket_t socket)
+{
+	TCPDisconnect(socket);
+}
+
+/******************************************************************************
+ * Gancho do transporte local
+ *****************************************************************************/
+void _TCPOnLocalReceive(_sSocket_t socket, CallbackReceiverTcp_t receiveCb, uint8_t *buffer, uint16_t len)
+{
+	if(receiveCb == NULL)
+		return;
+
+	TRACE(TRACE_EV_READ, socket, len);
+	m_rxSocket = socket;
+	TRACE(TRACE_EV_CALLBACK_ENTER, socket, len);
+	(*receiveCb)(buffer, len);
+	TRACE(TRACE_EV_CALLBACK_EXIT, socket, 0);
+	m_rxSocket = TCP_NO_SOCKET;
+}
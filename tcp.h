@@ -18,7 +18,7 @@
 #define TCP_NUMBER_SERVER_SOCKET		1
 
 // Numero maximo de clients que os servers irao administrar
-#define TCP_NUMBER_CLIENTS_TO_SERVER 	1
+#define TCP_NUMBER_CLIENTS_TO_SERVER 	8
 
 // Numero maximo de clients TCP para administrar
 #define TCP_NUMBER_CLIENT_SOCKET		1
@@ -29,6 +29,10 @@
 // Retorno para socket vago
 #define TCP_NO_SOCKET					-1
 
+// Handles das conexoes locais (memoria compartilhada), fora da faixa dos descritores
+#define TCP_LOCAL_SOCKET_BASE			0x40000000
+#define TCP_IS_LOCAL_SOCKET(socket)		((socket) >= TCP_LOCAL_SOCKET_BASE)
+
 /*****************************************************************************/
 enum
 {
@@ -43,8 +47,35 @@ enum
 	ERRCODE_TCP_ACCEPT_FAILED,				  	  // Falha no listen de conexoes
 	ERRCODE_TCP_WRITE_FAILED,				  	  // Falha na escrita correta de dados
 	ERRCODE_TCP_DISCONNECT_FAILED,				  // Falha na desconexao
+	ERRCODE_TCP_ENGINE_UNAVAILABLE,				  // Motor de I/O nao suportado
+};
+
+// Motores de I/O da camada TCP
+enum
+{
+	TCP_ENGINE_BLOCKING,		  				  // Uma thread por conexao, read() bloqueante
+	TCP_ENGINE_URING,		  					  // Thread unica io_uring (accept/recv multishot)
+};
+
+// Perfis de socket
+enum
+{
+	TCP_PROFILE_DEFAULT,		  				  // Opcoes padrao do sistema (Nagle ativo)
+	TCP_PROFILE_LOW_LATENCY,	  				  // TCP_NODELAY e TCP_QUICKACK em todas as conexoes
 };
 
+// Configuracao dos sockets criados pela camada; zero mantem o padrao do sistema
+typedef struct
+{
+	int profile;				// TCP_PROFILE_DEFAULT ou TCP_PROFILE_LOW_LATENCY
+	int rcvBufSz;				// SO_RCVBUF em bytes
+	int sndBufSz;				// SO_SNDBUF em bytes
+	int backlog;				// Conexoes pendentes no listen
+	int busyPollUs;				// SO_BUSY_POLL em us
+	bool busyPollLoop;			// Recepcao em laco sem bloqueio (motor bloqueante)
+	int busyPollCpu;			// Nucleo das threads do laco, -1 sem afinidade
+}sTcpProfile_t;
+
 // Definição do handle dos dados de conexão (definição para maior compatibilidade genérica)
 typedef int _sSocket_t;
 
@@ -69,6 +100,26 @@ typedef void (*CallbackConnection_t) (_sSocket_t socketClient, bool ConOrDiscon)
  */
 int TCPInit(void);
 //***************************************************************************
+/**
+ * @brief Selecao do motor de I/O. Deve ser chamada apos TCPInit e antes de
+ * qualquer TCPConnect. Em caso de falha o motor bloqueante e mantido.
+ *
+ * @param engine - TCP_ENGINE_BLOCKING ou TCP_ENGINE_URING
+ * @return Codigo de erro
+ */
+int TCPSetEngine(int engine);
+//***************************************************************************
+/**
+ * @brief Selecao das opcoes de socket. Deve ser chamada apos TCPInit e antes
+ * de qualquer TCPConnect; vale para os sockets criados e aceitos depois dela.
+ * Opcoes recusadas pelo sistema (ex.: SO_BUSY_POLL sem CAP_NET_ADMIN) sao
+ * informadas e ignoradas.
+ *
+ * @param profile - Configuracao desejada
+ * @return Codigo de erro
+ */
+int TCPSetProfile(const sTcpProfile_t *profile);
+//***************************************************************************
 /**
  * @brief Conexao a um ponto. Para o modo client, necessitamos do enderedo IP
  *
@@ -83,6 +134,22 @@ int TCPInit(void);
 int TCPConnect(bool serverMode,_sSocket_t *socket, char *ip, uint16_t port,
 CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb);
 //***************************************************************************
+/**
+ * @brief Conexao local por memoria compartilhada, para client e servidor na
+ * mesma maquina. Mesmo formato de TCPConnect: os handles criados valem para
+ * TCPSendData, TCPDisconnect, TCPIsConnected e TCPGetRxSocket. Cada mensagem
+ * enviada chega inteira, em uma chamada do callback de recepcao.
+ *
+ * @param serverMode - true cria o segmento e aceita os clients locais
+ * @param socket - Ponteiro para armazenar o handle criado
+ * @param name - Nome do segmento POSIX (ex.: "/socket-connector-1234")
+ * @param receiveCb: Callback para recepção de dados
+ * @param connectionCb: Callback para indicativo de conexao de client
+ * @return Codigo de erro
+ */
+int TCPConnectLocal(bool serverMode, _sSocket_t *socket, const char *name,
+					CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb);
+//***************************************************************************
 /**
  * @brief Desconexao
  *
@@ -107,5 +174,13 @@ bool TCPIsConnected (_sSocket_t  socket);
  * @return Codigo de erro
  */
 int TCPSendData(_sSocket_t socket, char *buffer, uint16_t len);
+//***************************************************************************
+/**
+ * @brief Socket de origem dos dados. Valido apenas dentro do callback de
+ * recepcao, para identificar e responder o client entre varios conectados.
+ *
+ * @return Handle do socket ou TCP_NO_SOCKET fora do callback
+ */
+_sSocket_t TCPGetRxSocket(void);
 
 #endif /* TCP_H_ */
@@ -0,0 +1,747 @@
+/**
+ ******************************************************************************
+ * @file    tcp_shm.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "tcp.h"
+#include "tcp_shm.h"
+#include "thread_wrapper.h"
+
+/**
+ * @note Cada client local ocupa uma posicao do segmento do servidor, com um
+ * anel SPSC por sentido (client -> servidor e servidor -> client). As
+ * mensagens sao gravadas como registros {tamanho, dados} e entregues inteiras.
+ * O consumidor gira por TCP_SHM_SPIN_US antes de dormir em um futex; o
+ * produtor so faz a chamada de sistema quando o consumidor esta dormindo.
+ * Threads de um mesmo processo enviando pela mesma conexao sao serializadas
+ * por um mutex local, mantendo um unico produtor por anel.
+ */
+
+/******************************************************************************
+ * Defines
+ *****************************************************************************/
+// Identificacao do segmento
+#define TCP_SHM_MAGIC					0x314D4853u		// "SHM1"
+#define TCP_SHM_VERSION					1
+
+// Tamanho de cada anel (potencia de 2)
+#define TCP_SHM_RING_SZ					(64 * 1024)
+
+// Maior mensagem aceita
+#define TCP_SHM_MAX_MSG					(TCP_SHM_RING_SZ / 4)
+
+// Clients locais por servidor
+#define TCP_SHM_SLOTS					TCP_NUMBER_CLIENTS_TO_SERVER
+
+// Conexoes acompanhadas por este processo
+#define TCP_SHM_MAX_CONNECTIONS			(TCP_SHM_SLOTS + TCP_NUMBER_CLIENT_SOCKET)
+
+// Handle do proprio servidor
+#define TCP_SHM_SERVER_HANDLE			(TCP_LOCAL_SOCKET_BASE + TCP_SHM_MAX_CONNECTIONS)
+
+// Espera ativa do consumidor antes de dormir, em us (nenhuma com um unico nucleo)
+#define TCP_SHM_SPIN_US					50
+
+// Sono maximo, em ms; ao acordar sem dados verifica se o outro processo existe
+#define TCP_SHM_IDLE_MS					500
+
+// Espera maxima por espaco no anel de envio, em ms
+#define TCP_SHM_SEND_TIMEOUT_MS			100
+
+// Registro de preenchimento: o proximo comeca no inicio do anel
+#define TCP_SHM_PAD						0xFFFFFFFFu
+
+#define TCP_SHM_ALIGN(len)				(((len) + 3u) & ~3u)
+
+// Lados que ja largaram uma posicao fechada
+#define TCP_SHM_DONE_SERVER				1u
+#define TCP_SHM_DONE_CLIENT				2u
+
+/******************************************************************************/
+enum _eShmSlotState
+{
+	_E_SHM_FREE,
+	_E_SHM_CLAIMED,			// Client inicializando os aneis
+	_E_SHM_OPEN,
+	_E_SHM_CLOSED,			// Um dos lados desconectou
+};
+
+struct _sShmRing
+{
+	uint32_t u32Head __attribute__((aligned(64)));		// Escrito pelo produtor
+	uint32_t u32Tail __attribute__((aligned(64)));		// Escrito pelo consumidor
+	uint32_t u32Waiting __attribute__((aligned(64)));	// Consumidor dormindo (palavra do futex)
+	uint8_t data[TCP_SHM_RING_SZ] __attribute__((aligned(64)));
+};
+
+struct _sShmSlot
+{
+	uint32_t u32State;
+	uint32_t u32Done;
+	int32_t i32ClientPid;
+	struct _sShmRing up;		// client -> servidor
+	struct _sShmRing down;		// servidor -> client
+};
+
+struct _sShmSegment
+{
+	uint32_t u32Magic;
+	uint32_t u32Version;
+	int32_t i32ServerPid;
+	uint32_t u32Doorbell __attribute__((aligned(64)));	// Incrementado a cada posicao aberta ou fechada
+	struct _sShmSlot slots[TCP_SHM_SLOTS];
+};
+
+// Conexao vista por este processo
+struct _sShmConnection
+{
+	bool bUsed;
+	bool bServer;				// Lado servidor da posicao
+	bool bClosing;
+	_sSocket_t handle;
+	uint32_t u32Slot;
+	struct _sShmSegment *psSegment;
+	struct _sShmSlot *psSlot;
+	struct _sShmRing *psRx;
+	struct _sShmRing *psTx;
+	pthread_mutex_t txLock;
+	sThread_t xthrRecvID;
+	CallbackReceiverTcp_t vCallbackTCPRx;
+	CallbackConnection_t vCallbackTCPConnect;
+};
+
+// Estrutura de trabalho
+struct {
+	struct _sShmConnection connections[TCP_SHM_MAX_CONNECTIONS];
+	pthread_mutex_t lock;
+
+	uint32_t u32SpinUs;
+
+	// Servidor
+	struct _sShmSegment *psServer;
+	char name[64];
+	bool bServerStop;
+	bool bAccepted[TCP_SHM_SLOTS];
+	sThread_t xthrServerID;
+	CallbackReceiverTcp_t vCallbackTCPRx;
+	CallbackConnection_t vCallbackTCPConnect;
+} m_sShmWork = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*****************************************************************************/
+/**
+ * @brief Thread que aceita os clients locais (servidor)
+ *
+ * @param arg
+ */
+void* _TCPShmThreadServer(void *arg);
+/**
+ * @brief Thread de recepcao de uma conexao local
+ *
+ * @param arg
+ */
+void* _TCPShmThreadRcve(void *arg);
+
+/*****************************************************************************/
+static inline void _TCPShmPause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile("yield" ::: "memory");
+#else
+	__asm__ volatile("" ::: "memory");
+#endif
+}
+//***************************************************************************
+static uint64_t _TCPShmNowUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000ull) + ((uint64_t)ts.tv_nsec / 1000);
+}
+//***************************************************************************
+// Futex compartilhado entre processos (sem FUTEX_PRIVATE_FLAG)
+static int _TCPShmFutexWait(uint32_t *word, uint32_t value, int timeoutMs)
+{
+	struct timespec ts = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+
+	return (int)syscall(SYS_futex, word, FUTEX_WAIT, value, &ts, NULL, 0);
+}
+//***************************************************************************
+static void _TCPShmFutexWake(uint32_t *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+//***************************************************************************
+static bool _TCPShmAlive(int32_t pid)
+{
+	return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+//***************************************************************************
+static void _TCPShmWakeConsumer(struct _sShmRing *ring)
+{
+	// Pareado com a publicacao do u32Waiting pelo consumidor
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring->u32Waiting, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&ring->u32Waiting, 0, __ATOMIC_RELAXED);
+		_TCPShmFutexWake(&ring->u32Waiting);
+	}
+}
+//***************************************************************************
+static void _TCPShmRingDoorbell(struct _sShmSegment *segment)
+{
+	__atomic_add_fetch(&segment->u32Doorbell, 1, __ATOMIC_RELEASE);
+	_TCPShmFutexWake(&segment->u32Doorbell);
+}
+//***************************************************************************
+// Produtor: false quando nao ha espaco
+static bool _TCPShmPush(struct _sShmRing *ring, const char *buffer, uint32_t len)
+{
+	uint32_t need = 4 + TCP_SHM_ALIGN(len);
+	uint32_t head = ring->u32Head;
+	uint32_t tail = __atomic_load_n(&ring->u32Tail, __ATOMIC_ACQUIRE);
+	uint32_t offset = head & (TCP_SHM_RING_SZ - 1);
+	uint32_t contiguous = TCP_SHM_RING_SZ - offset;
+	uint32_t total = (contiguous < need) ? contiguous + need : need;
+	uint32_t pad = TCP_SHM_PAD;
+
+	if((TCP_SHM_RING_SZ - (head - tail)) < total)
+		return false;
+
+	// O registro nunca da a volta: o resto do anel e pulado
+	if(contiguous < need)
+	{
+		memcpy(&ring->data[offset], &pad, sizeof(pad));
+		head += contiguous;
+		offset = 0;
+	}
+	memcpy(&ring->data[offset], &len, sizeof(len));
+	memcpy(&ring->data[offset + 4], buffer, len);
+	__atomic_store_n(&ring->u32Head, head + need, __ATOMIC_RELEASE);
+
+	_TCPShmWakeConsumer(ring);
+	return true;
+}
+//***************************************************************************
+// Consumidor: tamanho da mensagem copiada, -1 com o anel vazio ou -2 com um
+// registro corrompido
+static int _TCPShmPop(struct _sShmRing *ring, uint8_t *buffer)
+{
+	uint32_t tail = ring->u32Tail;
+	uint32_t head;
+	uint32_t offset;
+	uint32_t len;
+
+	// O anel e escrito por outro processo: nenhum tamanho lido dele e confiavel
+	if(tail & 3u)
+		return -2;
+
+	while(1)
+	{
+		head = __atomic_load_n(&ring->u32Head, __ATOMIC_ACQUIRE);
+		if(tail == head)
+			return -1;
+
+		offset = tail & (TCP_SHM_RING_SZ - 1);
+		memcpy(&len, &ring->data[offset], sizeof(len));
+		if(len != TCP_SHM_PAD)
+			break;
+		if((TCP_SHM_RING_SZ - offset) > (head - tail))
+			return -2;
+		tail += TCP_SHM_RING_SZ - offset;
+		__atomic_store_n(&ring->u32Tail, tail, __ATOMIC_RELEASE);
+	}
+
+	if((len > TCP_SHM_MAX_MSG) || ((offset + 4 + len) > TCP_SHM_RING_SZ) ||
+		((4 + TCP_SHM_ALIGN(len)) > (head - tail)))
+		return -2;
+	memcpy(buffer, &ring->data[offset + 4], len);
+	__atomic_store_n(&ring->u32Tail, tail + 4 + TCP_SHM_ALIGN(len), __ATOMIC_RELEASE);
+	return (int)len;
+}
+//***************************************************************************
+/**
+ * @brief Espera por dados: gira por TCP_SHM_SPIN_US e depois dorme ate ser
+ * acordado pelo produtor ou por TCP_SHM_IDLE_MS
+ *
+ * @return true quando dormiu o tempo todo sem ser acordado
+ */
+static bool _TCPShmWait(struct _sShmConnection *psConnection)
+{
+	struct _sShmRing *ring = psConnection->psRx;
+	uint32_t tail = ring->u32Tail;
+	uint64_t limit = _TCPShmNowUs() + m_sShmWork.u32SpinUs;
+	bool idle = false;
+
+	// Com um unico nucleo girar so atrasa o produtor
+	while(_TCPShmNowUs() < limit)
+	{
+		for(int i = 0; i < 64; i++)
+		{
+			if(__atomic_load_n(&ring->u32Head, __ATOMIC_ACQUIRE) != tail)
+				return false;
+			_TCPShmPause();
+		}
+	}
+
+	__atomic_store_n(&ring->u32Waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if((__atomic_load_n(&ring->u32Head, __ATOMIC_ACQUIRE) == tail) &&
+		!__atomic_load_n(&psConnection->bClosing, __ATOMIC_ACQUIRE))
+	{
+		idle = (_TCPShmFutexWait(&ring->u32Waiting, 1, TCP_SHM_IDLE_MS) < 0) && (errno == ETIMEDOUT);
+	}
+	__atomic_store_n(&ring->u32Waiting, 0, __ATOMIC_RELAXED);
+	return idle;
+}
+//***************************************************************************
+static struct _sShmConnection* _TCPShmGetConnection(_sSocket_t socket)
+{
+	int idx = socket - TCP_LOCAL_SOCKET_BASE;
+
+	if((idx < 0) || (idx >= TCP_SHM_MAX_CONNECTIONS) || !m_sShmWork.connections[idx].bUsed)
+		return NULL;
+	return &m_sShmWork.connections[idx];
+}
+//***************************************************************************
+static struct _sShmConnection* _TCPShmNewConnection(void)
+{
+	struct _sShmConnection *psConnection = NULL;
+
+	pthread_mutex_lock(&m_sShmWork.lock);
+	for(int i = 0; i < TCP_SHM_MAX_CONNECTIONS; i++)
+	{
+		if(!m_sShmWork.connections[i].bUsed)
+		{
+			psConnection = &m_sShmWork.connections[i];
+			memset(psConnection, 0, sizeof(*psConnection));
+			pthread_mutex_init(&psConnection->txLock, NULL);
+			psConnection->handle = TCP_LOCAL_SOCKET_BASE + i;
+			psConnection->bUsed = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m_sShmWork.lock);
+	return psConnection;
+}
+//***************************************************************************
+// Saida da thread de recepcao: fecha a posicao e libera quando os dois lados largaram
+static void _TCPShmRelease(struct _sShmConnection *psConnection)
+{
+	struct _sShmSlot *psSlot = psConnection->psSlot;
+	uint32_t mine = (psConnection->bServer) ? TCP_SHM_DONE_SERVER : TCP_SHM_DONE_CLIENT;
+	int32_t peer = (psConnection->bServer) ? psSlot->i32ClientPid : psConnection->psSegment->i32ServerPid;
+	uint32_t done;
+
+	// Nenhum envio em andamento a partir daqui
+	pthread_mutex_lock(&psConnection->txLock);
+	__atomic_store_n(&psConnection->bClosing, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&psConnection->txLock);
+
+	__atomic_store_n(&psSlot->u32State, _E_SHM_CLOSED, __ATOMIC_RELEASE);
+	_TCPShmWakeConsumer(psConnection->psTx);
+
+	if(psConnection->vCallbackTCPConnect != NULL)
+		(*psConnection->vCallbackTCPConnect)(psConnection->handle, false);
+
+	if(psConnection->bServer)
+	{
+		pthread_mutex_lock(&m_sShmWork.lock);
+		m_sShmWork.bAccepted[psConnection->u32Slot] = false;
+		pthread_mutex_unlock(&m_sShmWork.lock);
+	}
+
+	done = __atomic_or_fetch(&psSlot->u32Done, mine, __ATOMIC_ACQ_REL);
+	if((done == (TCP_SHM_DONE_SERVER | TCP_SHM_DONE_CLIENT)) || !_TCPShmAlive(peer))
+	{
+		psSlot->u32Done = 0;
+		__atomic_store_n(&psSlot->u32State, _E_SHM_FREE, __ATOMIC_RELEASE);
+	}
+	_TCPShmRingDoorbell(psConnection->psSegment);
+
+	if(!psConnection->bServer)
+		munmap(psConnection->psSegment, sizeof(struct _sShmSegment));
+
+	pthread_detach(pthread_self());
+	pthread_mutex_lock(&m_sShmWork.lock);
+	psConnection->bUsed = false;
+	pthread_mutex_unlock(&m_sShmWork.lock);
+}
+//***************************************************************************
+static int _TCPShmStartRcve(struct _sShmConnection *psConnection)
+{
+	if(threadCreate(&psConnection->xthrRecvID, "Shm-Rcve", _TCPShmThreadRcve, psConnection))
+	{
+		pthread_mutex_lock(&m_sShmWork.lock);
+		psConnection->bUsed = false;
+		pthread_mutex_unlock(&m_sShmWork.lock);
+		return ERRCODE_OS_FAILURE;
+	}
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+static int _TCPShmListen(_sSocket_t *socket, const char *name,
+						 CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb)
+{
+	struct _sShmSegment *psSegment;
+	int fd;
+
+	if(m_sShmWork.psServer != NULL)
+		return ERRCODE_TCP_NO_SPACE_FOR_CONNECTION;
+
+	// Segmento de um servidor anterior: os clients dele continuam no mapeamento antigo
+	shm_unlink(name);
+	// So processos do mesmo usuario: quem mapeia o segmento escreve nos aneis
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0)
+		return ERRCODE_TCP_SOCKET_FAILED;
+	if(ftruncate(fd, sizeof(struct _sShmSegment)))
+	{
+		close(fd);
+		shm_unlink(name);
+		return ERRCODE_TCP_SOCKET_FAILED;
+	}
+	psSegment = mmap(NULL, sizeof(struct _sShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(psSegment == MAP_FAILED)
+	{
+		shm_unlink(name);
+		return ERRCODE_TCP_SOCKET_FAILED;
+	}
+
+	psSegment->u32Version = TCP_SHM_VERSION;
+	psSegment->i32ServerPid = (int32_t)getpid();
+	__atomic_store_n(&psSegment->u32Magic, TCP_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	snprintf(m_sShmWork.name, sizeof(m_sShmWork.name), "%s", name);
+	memset(m_sShmWork.bAccepted, 0, sizeof(m_sShmWork.bAccepted));
+	m_sShmWork.vCallbackTCPRx = receiveCb;
+	m_sShmWork.vCallbackTCPConnect = connectionCb;
+	m_sShmWork.bServerStop = false;
+	m_sShmWork.psServer = psSegment;
+
+	if(threadCreate(&m_sShmWork.xthrServerID, "Shm-Server", _TCPShmThreadServer, NULL))
+	{
+		m_sShmWork.psServer = NULL;
+		munmap(psSegment, sizeof(struct _sShmSegment));
+		shm_unlink(name);
+		return ERRCODE_OS_FAILURE;
+	}
+
+	*socket = TCP_SHM_SERVER_HANDLE;
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+static int _TCPShmJoin(_sSocket_t *socket, const char *name,
+					   CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb)
+{
+	struct _sShmConnection *psConnection;
+	struct _sShmSegment *psSegment;
+	struct _sShmSlot *psSlot = NULL;
+	uint32_t slot;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if(fd < 0)
+		return ERRCODE_TCP_CONNECTION_FAILED;
+	psSegment = mmap(NULL, sizeof(struct _sShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(psSegment == MAP_FAILED)
+		return ERRCODE_TCP_CONNECTION_FAILED;
+
+	if((__atomic_load_n(&psSegment->u32Magic, __ATOMIC_ACQUIRE) != TCP_SHM_MAGIC) ||
+		(psSegment->u32Version != TCP_SHM_VERSION) || !_TCPShmAlive(psSegment->i32ServerPid))
+	{
+		munmap(psSegment, sizeof(struct _sShmSegment));
+		return ERRCODE_TCP_CONNECTION_FAILED;
+	}
+
+	for(slot = 0; slot < TCP_SHM_SLOTS; slot++)
+	{
+		uint32_t expected = _E_SHM_FREE;
+
+		if(__atomic_compare_exchange_n(&psSegment->slots[slot].u32State, &expected, _E_SHM_CLAIMED, false,
+										__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		{
+			psSlot = &psSegment->slots[slot];
+			break;
+		}
+	}
+	psConnection = (psSlot != NULL) ? _TCPShmNewConnection() : NULL;
+	if(psConnection == NULL)
+	{
+		if(psSlot != NULL)
+			__atomic_store_n(&psSlot->u32State, _E_SHM_FREE, __ATOMIC_RELEASE);
+		munmap(psSegment, sizeof(struct _sShmSegment));
+		return ERRCODE_TCP_NO_SPACE_FOR_CONNECTION;
+	}
+
+	psSlot->up.u32Head = psSlot->up.u32Tail = psSlot->up.u32Waiting = 0;
+	psSlot->down.u32Head = psSlot->down.u32Tail = psSlot->down.u32Waiting = 0;
+	psSlot->u32Done = 0;
+	psSlot->i32ClientPid = (int32_t)getpid();
+
+	psConnection->bServer = false;
+	psConnection->u32Slot = slot;
+	psConnection->psSegment = psSegment;
+	psConnection->psSlot = psSlot;
+	psConnection->psRx = &psSlot->down;
+	psConnection->psTx = &psSlot->up;
+	psConnection->vCallbackTCPRx = receiveCb;
+	psConnection->vCallbackTCPConnect = connectionCb;
+
+	__atomic_store_n(&psSlot->u32State, _E_SHM_OPEN, __ATOMIC_RELEASE);
+	if(_TCPShmStartRcve(psConnection) != ERRCODE_NO_ERROR)
+	{
+		__atomic_store_n(&psSlot->u32State, _E_SHM_FREE, __ATOMIC_RELEASE);
+		munmap(psSegment, sizeof(struct _sShmSegment));
+		return ERRCODE_OS_FAILURE;
+	}
+	_TCPShmRingDoorbell(psSegment);
+
+	*socket = psConnection->handle;
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+// Conexao do lado servidor para uma posicao aberta por um client, ou ja fechada por ele
+static void _TCPShmAccept(uint32_t slot)
+{
+	struct _sShmSlot *psSlot = &m_sShmWork.psServer->slots[slot];
+	struct _sShmConnection *psConnection;
+
+	psConnection = _TCPShmNewConnection();
+	if(psConnection == NULL)
+	{
+		// Sem espaco: o client ve a posicao fechada
+		__atomic_store_n(&psSlot->u32State, _E_SHM_CLOSED, __ATOMIC_RELEASE);
+		__atomic_or_fetch(&psSlot->u32Done, TCP_SHM_DONE_SERVER, __ATOMIC_ACQ_REL);
+		_TCPShmWakeConsumer(&psSlot->down);
+		return;
+	}
+
+	psConnection->bServer = true;
+	psConnection->u32Slot = slot;
+	psConnection->psSegment = m_sShmWork.psServer;
+	psConnection->psSlot = psSlot;
+	psConnection->psRx = &psSlot->up;
+	psConnection->psTx = &psSlot->down;
+	psConnection->vCallbackTCPRx = m_sShmWork.vCallbackTCPRx;
+	psConnection->vCallbackTCPConnect = m_sShmWork.vCallbackTCPConnect;
+
+	pthread_mutex_lock(&m_sShmWork.lock);
+	m_sShmWork.bAccepted[slot] = true;
+	pthread_mutex_unlock(&m_sShmWork.lock);
+
+	if(_TCPShmStartRcve(psConnection) != ERRCODE_NO_ERROR)
+	{
+		// Como sem espaco: o client larga a posicao sozinho
+		pthread_mutex_lock(&m_sShmWork.lock);
+		m_sShmWork.bAccepted[slot] = false;
+		pthread_mutex_unlock(&m_sShmWork.lock);
+		__atomic_store_n(&psSlot->u32State, _E_SHM_CLOSED, __ATOMIC_RELEASE);
+		__atomic_or_fetch(&psSlot->u32Done, TCP_SHM_DONE_SERVER, __ATOMIC_ACQ_REL);
+		_TCPShmWakeConsumer(&psSlot->down);
+		return;
+	}
+
+	// So com a recepcao de pe, como nas conexoes TCP
+	if(psConnection->vCallbackTCPConnect != NULL)
+		(*psConnection->vCallbackTCPConnect)(psConnection->handle, true);
+}
+
+/*****************************************************************************/
+int TCPShmConnect(bool serverMode, _sSocket_t *socket, const char *name,
+				  CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb)
+{
+	if((socket == NULL) || (name == NULL))
+		return ERRCODE_PARAMETRO_INVALIDO;
+
+	m_sShmWork.u32SpinUs = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? TCP_SHM_SPIN_US : 0;
+
+	if(serverMode)
+		return _TCPShmListen(socket, name, receiveCb, connectionCb);
+	return _TCPShmJoin(socket, name, receiveCb, connectionCb);
+}
+//***************************************************************************
+int TCPShmSend(_sSocket_t socket, const char *buffer, uint16_t len)
+{
+	struct _sShmConnection *psConnection;
+	uint64_t deadline;
+	int ret = ERRCODE_TCP_WRITE_FAILED;
+
+	psConnection = _TCPShmGetConnection(socket);
+	if((psConnection == NULL) || (len > TCP_SHM_MAX_MSG))
+		return ERRCODE_PARAMETRO_INVALIDO;
+	if(len == 0)
+		return ERRCODE_NO_ERROR;
+
+	pthread_mutex_lock(&psConnection->txLock);
+	deadline = 0;
+	while(!psConnection->bClosing &&
+		  (__atomic_load_n(&psConnection->psSlot->u32State, __ATOMIC_ACQUIRE) == _E_SHM_OPEN))
+	{
+		if(_TCPShmPush(psConnection->psTx, buffer, len))
+		{
+			ret = ERRCODE_NO_ERROR;
+			break;
+		}
+
+		// Anel cheio: o consumidor esta atrasado
+		if(deadline == 0)
+			deadline = _TCPShmNowUs() + (TCP_SHM_SEND_TIMEOUT_MS * 1000);
+		else if(_TCPShmNowUs() > deadline)
+			break;
+		usleep(50);
+	}
+	pthread_mutex_unlock(&psConnection->txLock);
+	return ret;
+}
+//***************************************************************************
+int TCPShmDisconnect(_sSocket_t socket)
+{
+	struct _sShmConnection *psConnection;
+
+	if(socket == TCP_SHM_SERVER_HANDLE)
+	{
+		if(m_sShmWork.psServer == NULL)
+			return ERRCODE_PARAMETRO_INVALIDO;
+
+		__atomic_store_n(&m_sShmWork.bServerStop, true, __ATOMIC_RELEASE);
+		_TCPShmRingDoorbell(m_sShmWork.psServer);
+		pthread_join(m_sShmWork.xthrServerID.handle, NULL);
+
+		// As threads de recepcao ainda usam o mapeamento: so o nome e removido
+		for(int i = 0; i < TCP_SHM_MAX_CONNECTIONS; i++)
+		{
+			if(m_sShmWork.connections[i].bUsed && m_sShmWork.connections[i].bServer)
+				TCPShmDisconnect(m_sShmWork.connections[i].handle);
+		}
+		shm_unlink(m_sShmWork.name);
+		m_sShmWork.psServer = NULL;
+		return ERRCODE_NO_ERROR;
+	}
+
+	psConnection = _TCPShmGetConnection(socket);
+	if(psConnection == NULL)
+		return ERRCODE_PARAMETRO_INVALIDO;
+
+	// A thread de recepcao fecha a posicao e chama o callback ao sair
+	__atomic_store_n(&psConnection->bClosing, true, __ATOMIC_RELEASE);
+	__atomic_store_n(&psConnection->psRx->u32Waiting, 0, __ATOMIC_RELAXED);
+	_TCPShmFutexWake(&psConnection->psRx->u32Waiting);
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+bool TCPShmIsConnected(_sSocket_t socket)
+{
+	struct _sShmConnection *psConnection;
+
+	if(socket == TCP_SHM_SERVER_HANDLE)
+		return (m_sShmWork.psServer != NULL);
+
+	psConnection = _TCPShmGetConnection(socket);
+	return (psConnection != NULL) && !psConnection->bClosing &&
+		   (__atomic_load_n(&psConnection->psSlot->u32State, __ATOMIC_ACQUIRE) == _E_SHM_OPEN);
+}
+
+/*****************************************************************************/
+void* _TCPShmThreadServer(void *arg)
+{
+	struct _sShmSegment *psSegment = m_sShmWork.psServer;
+	uint32_t doorbell;
+
+	while(!__atomic_load_n(&m_sShmWork.bServerStop, __ATOMIC_ACQUIRE))
+	{
+		doorbell = __atomic_load_n(&psSegment->u32Doorbell, __ATOMIC_ACQUIRE);
+
+		for(uint32_t slot = 0; slot < TCP_SHM_SLOTS; slot++)
+		{
+			struct _sShmSlot *psSlot = &psSegment->slots[slot];
+			uint32_t state = __atomic_load_n(&psSlot->u32State, __ATOMIC_ACQUIRE);
+
+			if(m_sShmWork.bAccepted[slot])
+				continue;
+
+			// Fechada pelo client antes de ser aceita: como no TCP, o que ele enviou
+			// antes de fechar e entregue; a recepcao esvazia o anel e libera a posicao
+			if((state == _E_SHM_OPEN) ||
+				((state == _E_SHM_CLOSED) &&
+				 !(__atomic_load_n(&psSlot->u32Done, __ATOMIC_ACQUIRE) & TCP_SHM_DONE_SERVER)))
+			{
+				_TCPShmAccept(slot);
+			}
+		}
+
+		_TCPShmFutexWait(&psSegment->u32Doorbell, doorbell, TCP_SHM_IDLE_MS);
+	}
+	return NULL;
+}
+//***************************************************************************
+void* _TCPShmThreadRcve(void *arg)
+{
+	struct _sShmConnection *psConnection = (struct _sShmConnection*)arg;
+	uint8_t *buffer;
+	int32_t peer;
+	int len;
+
+	// Um byte extra para o terminador nulo, como na recepcao TCP
+	buffer = malloc(TCP_SHM_MAX_MSG + 1);
+	if(buffer == NULL)
+	{
+		_TCPShmRelease(psConnection);
+		return NULL;
+	}
+
+	while(1)
+	{
+		len = _TCPShmPop(psConnection->psRx, buffer);
+		if(len >= 0)
+		{
+			buffer[len] = 0;
+			_TCPOnLocalReceive(psConnection->handle, psConnection->vCallbackTCPRx, buffer, (uint16_t)len);
+			continue;
+		}
+		if(len < -1)
+		{
+			// Registro corrompido: o resto do anel tambem nao e confiavel
+			break;
+		}
+
+		if(__atomic_load_n(&psConnection->bClosing, __ATOMIC_ACQUIRE) ||
+			(__atomic_load_n(&psConnection->psSlot->u32State, __ATOMIC_ACQUIRE) != _E_SHM_OPEN))
+			break;
+
+		if(_TCPShmWait(psConnection))
+		{
+			// Sem noticias do outro lado: o processo pode ter terminado sem desconectar
+			peer = (psConnection->bServer) ? psConnection->psSlot->i32ClientPid :
+											 psConnection->psSegment->i32ServerPid;
+			if(!_TCPShmAlive(peer))
+				break;
+		}
+	}
+
+	free(buffer);
+	_TCPShmRelease(psConnection);
+	return NULL;
+}
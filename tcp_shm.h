@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file    tcp_shm.h
+ * @author  Rafael Martins
+ * @brief   Transporte local por memoria compartilhada (uso interno de tcp.c)
+ ******************************************************************************
+ */
+
+#ifndef TCP_SHM_H_
+#define TCP_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tcp.h"
+
+/******************************************************************************/
+/**
+ * @brief Cria o segmento e a thread que aceita os clients (servidor), ou
+ * ocupa uma posicao livre de um segmento existente (client)
+ *
+ * @param serverMode - Servidor (true) ou client (false)
+ * @param socket - Ponteiro para armazenar o handle criado
+ * @param name - Nome do segmento
+ * @param receiveCb - Callback de recepcao
+ * @param connectionCb - Callback de conexao
+ * @return Codigo de erro
+ */
+int TCPShmConnect(bool serverMode, _sSocket_t *socket, const char *name,
+				  CallbackReceiverTcp_t receiveCb, CallbackConnection_t connectionCb);
+//***************************************************************************
+/**
+ * @brief Copia uma mensagem para o anel de envio e acorda o consumidor,
+ * se estiver dormindo
+ *
+ * @param socket - Handle da conexao
+ * @param buffer - Dados
+ * @param len - Tamanho dos dados
+ * @return Codigo de erro
+ */
+int TCPShmSend(_sSocket_t socket, const char *buffer, uint16_t len);
+//***************************************************************************
+/**
+ * @brief Encerra a conexao; o callback de desconexao e chamado pela thread
+ * de recepcao ao sair
+ *
+ * @param socket - Handle da conexao
+ * @return Codigo de erro
+ */
+int TCPShmDisconnect(_sSocket_t socket);
+//***************************************************************************
+/**
+ * @brief Estado da conexao
+ *
+ * @param socket - Handle da conexao
+ * @return true se conectado
+ */
+bool TCPShmIsConnected(_sSocket_t socket);
+
+/******************************************************************************
+ * Gancho implementado em tcp.c
+ *****************************************************************************/
+/**
+ * @brief Entrega de uma mensagem ao callback, com o socket de origem
+ * disponivel em TCPGetRxSocket
+ */
+void _TCPOnLocalReceive(_sSocket_t socket, CallbackReceiverTcp_t receiveCb, uint8_t *buffer, uint16_t len);
+
+#endif /* TCP_SHM_H_ */
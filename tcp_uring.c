@@ -0,0 +1,721 @@
+/**
+ ******************************************************************************
+ * @file    tcp_uring.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "tcp.h"
+#include "tcp_uring.h"
+#include "thread_wrapper.h"
+
+/**
+ * @note O motor io_uring atende todos os sockets em uma unica thread:
+ * - accept multishot no socket de listen (um SQE gera todas as conexoes);
+ * - recv multishot com buffer ring (o kernel escolhe o buffer de recepcao);
+ * - envios copiados para uma area registrada (IORING_REGISTER_BUFFERS) e
+ *   escritos com WRITE_FIXED. Envios feitos dentro dos callbacks sao
+ *   acumulados e submetidos juntos no proximo io_uring_enter da thread.
+ * Requer kernel 6.0 ou superior.
+ */
+
+#ifdef TCP_HAVE_URING
+#include <linux/io_uring.h>
+
+/******************************************************************************
+ * Defines
+ *****************************************************************************/
+// Numero de entradas do anel de submissao
+#define TCP_URING_ENTRIES				256
+
+// Numero de buffers de recepcao no buffer ring (potencia de 2)
+#define TCP_URING_RECV_BUFFERS			64
+
+// Distancia entre buffers de recepcao (um byte extra para o terminador nulo)
+#define TCP_URING_RECV_STRIDE			(TCP_BUFFER_SZ + 1)
+
+// Grupo do buffer ring de recepcao
+#define TCP_URING_BUFFER_GROUP			0
+
+// Tamanho de cada metade da area de envio de um socket
+#define TCP_URING_SEND_SZ				(4 * TCP_BUFFER_SZ)
+
+// Numero maximo de sockets acompanhados pelo motor
+#define TCP_URING_MAX_SOCKETS			(TCP_NUMBER_CONNECTIONS + \
+										(TCP_NUMBER_SERVER_SOCKET * TCP_NUMBER_CLIENTS_TO_SERVER))
+
+// Codificacao do user_data: operacao na parte alta, indice do socket na baixa
+#define TCP_URING_USER_DATA(op, idx)	(((uint64_t)(op) << 32) | (uint32_t)(idx))
+#define TCP_URING_OP(data)				((uint32_t)((data) >> 32))
+#define TCP_URING_IDX(data)				((uint32_t)(data))
+
+/******************************************************************************/
+enum _eUringOp
+{
+	_E_URING_OP_ACCEPT = 1,
+	_E_URING_OP_RECV,
+	_E_URING_OP_SEND,
+};
+
+// Estado de um socket dentro do motor
+struct _sUringSocket
+{
+	_sSocket_t handle;
+	bool bListener;
+	bool bArmed;			// accept/recv multishot ativo no kernel
+	bool bClosing;			// TCPDisconnect ja liberou o socket
+	bool bSendInFlight;
+	uint8_t u8Stage;		// metade da area de envio em preenchimento
+	uint32_t u32Staged;		// bytes aguardando envio
+	uint32_t u32InFlight;	// bytes da escrita em andamento
+	uint32_t u32Sent;		// bytes ja escritos da escrita em andamento
+};
+
+// Estrutura de trabalho
+struct {
+	int fd;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned sqEntries;
+	unsigned sqLocalTail;
+	unsigned toSubmit;
+	struct io_uring_sqe *sqes;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+
+	struct io_uring_buf_ring *bufRing;
+	uint16_t bufTail;
+	uint8_t *recvArena;
+	uint8_t *sendArena;
+
+	struct _sUringSocket sockets[TCP_URING_MAX_SOCKETS];
+	pthread_mutex_t lock;
+	sThread_t xthrLoopID;
+	bool bReady;
+} m_sUringWork = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*****************************************************************************/
+/**
+ * @brief Thread de eventos do motor
+ *
+ * @param arg
+ */
+void* _TCPUringThreadLoop(void *arg);
+
+/*****************************************************************************/
+static int _uringEnter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, m_sUringWork.fd, toSubmit, minComplete, flags, NULL, 0);
+}
+//***************************************************************************
+static bool _uringInLoop(void)
+{
+	return pthread_equal(pthread_self(), m_sUringWork.xthrLoopID.handle);
+}
+//***************************************************************************
+// Submete o que estiver pendente (lock adquirido)
+static int _uringSubmit(void)
+{
+	int ret;
+
+	while(m_sUringWork.toSubmit)
+	{
+		ret = _uringEnter(m_sUringWork.toSubmit, 0, 0);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return ERRCODE_OS_FAILURE;
+		}
+		m_sUringWork.toSubmit -= ((unsigned)ret > m_sUringWork.toSubmit) ? m_sUringWork.toSubmit : (unsigned)ret;
+		if(ret == 0)
+			break;
+	}
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+// Reserva um SQE zerado (lock adquirido). Esvazia o anel caso esteja cheio.
+static struct io_uring_sqe* _uringGetSqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head;
+	unsigned idx;
+
+	head = __atomic_load_n(m_sUringWork.sqHead, __ATOMIC_ACQUIRE);
+	if(m_sUringWork.sqLocalTail - head >= m_sUringWork.sqEntries)
+	{
+		_uringSubmit();
+		head = __atomic_load_n(m_sUringWork.sqHead, __ATOMIC_ACQUIRE);
+		if(m_sUringWork.sqLocalTail - head >= m_sUringWork.sqEntries)
+			return NULL;
+	}
+
+	idx = m_sUringWork.sqLocalTail & *m_sUringWork.sqMask;
+	sqe = &m_sUringWork.sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	m_sUringWork.sqArray[idx] = idx;
+	return sqe;
+}
+//***************************************************************************
+// Publica o SQE reservado por _uringGetSqe (lock adquirido)
+static void _uringCommitSqe(void)
+{
+	m_sUringWork.sqLocalTail++;
+	m_sUringWork.toSubmit++;
+	__atomic_store_n(m_sUringWork.sqTail, m_sUringWork.sqLocalTail, __ATOMIC_RELEASE);
+}
+//***************************************************************************
+static uint8_t* _uringSendHalf(unsigned idx, unsigned half)
+{
+	return m_sUringWork.sendArena + ((idx * 2) + half) * TCP_URING_SEND_SZ;
+}
+//***************************************************************************
+static void _uringRecycle(uint16_t bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &m_sUringWork.bufRing->bufs[m_sUringWork.bufTail & (TCP_URING_RECV_BUFFERS - 1)];
+	buf->addr = (uint64_t)(uintptr_t)(m_sUringWork.recvArena + (bid * TCP_URING_RECV_STRIDE));
+	buf->len = TCP_BUFFER_SZ;
+	buf->bid = bid;
+	m_sUringWork.bufTail++;
+	__atomic_store_n(&m_sUringWork.bufRing->tail, m_sUringWork.bufTail, __ATOMIC_RELEASE);
+}
+//***************************************************************************
+static int _uringArm(unsigned idx)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+	struct io_uring_sqe *sqe;
+
+	sqe = _uringGetSqe();
+	if(sqe == NULL)
+		return ERRCODE_OS_FAILURE;
+
+	sqe->fd = ps->handle;
+	if(ps->bListener)
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->user_data = TCP_URING_USER_DATA(_E_URING_OP_ACCEPT, idx);
+	}
+	else
+	{
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = TCP_URING_BUFFER_GROUP;
+		sqe->user_data = TCP_URING_USER_DATA(_E_URING_OP_RECV, idx);
+	}
+	_uringCommitSqe();
+	ps->bArmed = true;
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+// Escreve o restante da escrita em andamento
+static int _uringPrepSend(unsigned idx)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+	struct io_uring_sqe *sqe;
+
+	sqe = _uringGetSqe();
+	if(sqe == NULL)
+		return ERRCODE_OS_FAILURE;
+
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->fd = ps->handle;
+	sqe->addr = (uint64_t)(uintptr_t)(_uringSendHalf(idx, ps->u8Stage ^ 1) + ps->u32Sent);
+	sqe->len = ps->u32InFlight - ps->u32Sent;
+	sqe->buf_index = 0;
+	sqe->user_data = TCP_URING_USER_DATA(_E_URING_OP_SEND, idx);
+	_uringCommitSqe();
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+// Troca as metades: o que foi acumulado passa a ser a escrita em andamento
+static int _uringStartSend(unsigned idx)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+
+	ps->u32InFlight = ps->u32Staged;
+	ps->u32Sent = 0;
+	ps->u32Staged = 0;
+	ps->u8Stage ^= 1;
+	ps->bSendInFlight = true;
+	if(_uringPrepSend(idx) != ERRCODE_NO_ERROR)
+	{
+		ps->bSendInFlight = false;
+		return ERRCODE_TCP_WRITE_FAILED;
+	}
+	return ERRCODE_NO_ERROR;
+}
+//***************************************************************************
+static int _uringFindSocket(_sSocket_t socket)
+{
+	int i;
+
+	for(i = 0; i < TCP_URING_MAX_SOCKETS; i++)
+	{
+		if((m_sUringWork.sockets[i].handle == socket) && !m_sUringWork.sockets[i].bClosing)
+			return i;
+	}
+	return TCP_NO_SOCKET;
+}
+//***************************************************************************
+static int _uringAddSocket(_sSocket_t socket, bool listener)
+{
+	int i;
+	int ret;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	for(i = 0; i < TCP_URING_MAX_SOCKETS; i++)
+	{
+		if(m_sUringWork.sockets[i].handle == TCP_NO_SOCKET)
+			break;
+	}
+	if(i == TCP_URING_MAX_SOCKETS)
+	{
+		ret = ERRCODE_TCP_NO_SPACE_FOR_CONNECTION;
+		goto exit;
+	}
+
+	memset(&m_sUringWork.sockets[i], 0, sizeof(m_sUringWork.sockets[i]));
+	m_sUringWork.sockets[i].handle = socket;
+	m_sUringWork.sockets[i].bListener = listener;
+	ret = _uringArm(i);
+	if(ret)
+	{
+		m_sUringWork.sockets[i].handle = TCP_NO_SOCKET;
+		goto exit;
+	}
+	if(!_uringInLoop())
+		ret = _uringSubmit();
+
+exit:
+	pthread_mutex_unlock(&m_sUringWork.lock);
+	return ret;
+}
+//***************************************************************************
+// Libera a posicao quando o kernel nao referencia mais o socket (lock adquirido)
+static void _uringTryRelease(unsigned idx)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+
+	if(ps->bClosing && !ps->bArmed && !ps->bSendInFlight)
+	{
+		ps->handle = TCP_NO_SOCKET;
+		ps->bClosing = false;
+	}
+}
+//***************************************************************************
+static void _uringHandleAccept(unsigned idx, int32_t res, uint32_t flags)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+
+	if(res >= 0)
+	{
+		if(ps->bClosing || !_TCPOnAccept(ps->handle, res))
+		{
+			shutdown(res, SHUT_RDWR);
+			close(res);
+		}
+	}
+
+	if(flags & IORING_CQE_F_MORE)
+		return;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	ps->bArmed = false;
+	if(!ps->bClosing && (res != -EINVAL) && (res != -EBADF))
+	{
+		_uringArm(idx);
+	}
+	else
+	{
+		ps->bClosing = true;
+		_uringTryRelease(idx);
+	}
+	pthread_mutex_unlock(&m_sUringWork.lock);
+}
+//***************************************************************************
+static void _uringHandleRecv(unsigned idx, int32_t res, uint32_t flags)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+	_sSocket_t handle = ps->handle;
+	bool closed;
+
+	if((res > 0) && (flags & IORING_CQE_F_BUFFER))
+	{
+		uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+		uint8_t *buffer = m_sUringWork.recvArena + (bid * TCP_URING_RECV_STRIDE);
+
+		if(!ps->bClosing)
+		{
+			buffer[res] = 0;
+			_TCPOnReceive(ps->handle, buffer, (uint16_t)res);
+		}
+		pthread_mutex_lock(&m_sUringWork.lock);
+		_uringRecycle(bid);
+		pthread_mutex_unlock(&m_sUringWork.lock);
+	}
+
+	if(flags & IORING_CQE_F_MORE)
+		return;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	ps->bArmed = false;
+	if(!ps->bClosing && ((res > 0) || (res == -ENOBUFS)))
+	{
+		_uringArm(idx);
+		pthread_mutex_unlock(&m_sUringWork.lock);
+		return;
+	}
+	closed = !ps->bClosing;
+	pthread_mutex_unlock(&m_sUringWork.lock);
+
+	// Ao ler ZERO (ou erro), indicio de que tivemos uma desconexao
+	if(closed)
+	{
+		_TCPOnClosed(handle);
+	}
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	if(ps->handle == handle)
+	{
+		ps->bClosing = true;
+		_uringTryRelease(idx);
+	}
+	pthread_mutex_unlock(&m_sUringWork.lock);
+}
+//***************************************************************************
+static void _uringHandleSend(unsigned idx, int32_t res)
+{
+	struct _sUringSocket *ps = &m_sUringWork.sockets[idx];
+	bool failed = false;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	if(res <= 0)
+	{
+		ps->bSendInFlight = false;
+		ps->u32Staged = 0;
+		failed = !ps->bClosing;
+	}
+	else
+	{
+		ps->u32Sent += (uint32_t)res;
+		if(ps->u32Sent < ps->u32InFlight)
+		{
+			// Escrita parcial, envia o restante
+			if(ps->bClosing || _uringPrepSend(idx))
+				ps->bSendInFlight = false;
+		}
+		else
+		{
+			ps->bSendInFlight = false;
+			if(ps->u32Staged && !ps->bClosing)
+				_uringStartSend(idx);
+		}
+	}
+	_uringTryRelease(idx);
+	pthread_mutex_unlock(&m_sUringWork.lock);
+
+	// O recv do socket percebe o shutdown e conclui a desconexao
+	if(failed)
+		shutdown(ps->handle, SHUT_RDWR);
+}
+
+/*****************************************************************************/
+int TCPUringInit(void)
+{
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	struct iovec iov;
+	size_t sqSz, cqSz;
+	uint8_t *sqPtr, *cqPtr;
+	size_t sendSz;
+	int i;
+
+	if(m_sUringWork.bReady)
+		return ERRCODE_NO_ERROR;
+
+	memset(&params, 0, sizeof(params));
+	m_sUringWork.fd = (int)syscall(__NR_io_uring_setup, TCP_URING_ENTRIES, &params);
+	if(m_sUringWork.fd < 0)
+	{
+		printf("io_uring setup failed: %s\n", strerror(errno));
+		return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+	}
+
+	// Mapeamento dos aneis
+	sqSz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqSz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(cqSz > sqSz)
+			sqSz = cqSz;
+		cqSz = sqSz;
+	}
+	sqPtr = mmap(NULL, sqSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				 m_sUringWork.fd, IORING_OFF_SQ_RING);
+	if(sqPtr == MAP_FAILED)
+		goto error;
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		cqPtr = sqPtr;
+	}
+	else
+	{
+		cqPtr = mmap(NULL, cqSz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					 m_sUringWork.fd, IORING_OFF_CQ_RING);
+		if(cqPtr == MAP_FAILED)
+			goto error;
+	}
+	m_sUringWork.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+							 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+							 m_sUringWork.fd, IORING_OFF_SQES);
+	if(m_sUringWork.sqes == MAP_FAILED)
+		goto error;
+
+	m_sUringWork.sqHead  = (unsigned*)(sqPtr + params.sq_off.head);
+	m_sUringWork.sqTail  = (unsigned*)(sqPtr + params.sq_off.tail);
+	m_sUringWork.sqMask  = (unsigned*)(sqPtr + params.sq_off.ring_mask);
+	m_sUringWork.sqArray = (unsigned*)(sqPtr + params.sq_off.array);
+	m_sUringWork.sqEntries = params.sq_entries;
+	m_sUringWork.sqLocalTail = *m_sUringWork.sqTail;
+	m_sUringWork.cqHead  = (unsigned*)(cqPtr + params.cq_off.head);
+	m_sUringWork.cqTail  = (unsigned*)(cqPtr + params.cq_off.tail);
+	m_sUringWork.cqMask  = (unsigned*)(cqPtr + params.cq_off.ring_mask);
+	m_sUringWork.cqes    = (struct io_uring_cqe*)(cqPtr + params.cq_off.cqes);
+
+	// Buffer ring de recepcao
+	m_sUringWork.bufRing = mmap(NULL, TCP_URING_RECV_BUFFERS * sizeof(struct io_uring_buf),
+								PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	m_sUringWork.recvArena = malloc(TCP_URING_RECV_BUFFERS * TCP_URING_RECV_STRIDE);
+	if((m_sUringWork.bufRing == MAP_FAILED) || (m_sUringWork.recvArena == NULL))
+		goto error;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)m_sUringWork.bufRing;
+	reg.ring_entries = TCP_URING_RECV_BUFFERS;
+	reg.bgid = TCP_URING_BUFFER_GROUP;
+	if(syscall(__NR_io_uring_register, m_sUringWork.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		printf("io_uring buffer ring not supported: %s\n", strerror(errno));
+		goto error;
+	}
+	m_sUringWork.bufTail = 0;
+	for(i = 0; i < TCP_URING_RECV_BUFFERS; i++)
+	{
+		_uringRecycle((uint16_t)i);
+	}
+
+	// Area de envio registrada: duas metades por socket
+	sendSz = TCP_URING_MAX_SOCKETS * 2 * TCP_URING_SEND_SZ;
+	m_sUringWork.sendArena = mmap(NULL, sendSz, PROT_READ | PROT_WRITE,
+								  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(m_sUringWork.sendArena == MAP_FAILED)
+		goto error;
+	iov.iov_base = m_sUringWork.sendArena;
+	iov.iov_len = sendSz;
+	if(syscall(__NR_io_uring_register, m_sUringWork.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+	{
+		printf("io_uring register buffers failed: %s\n", strerror(errno));
+		goto error;
+	}
+
+	for(i = 0; i < TCP_URING_MAX_SOCKETS; i++)
+	{
+		m_sUringWork.sockets[i].handle = TCP_NO_SOCKET;
+	}
+
+	if(threadCreate(&m_sUringWork.xthrLoopID, "TCP-Uring", _TCPUringThreadLoop, NULL))
+		goto error;
+
+	m_sUringWork.bReady = true;
+	return ERRCODE_NO_ERROR;
+
+error:
+	// Os mapeamentos sao descartados junto com o descritor
+	close(m_sUringWork.fd);
+	m_sUringWork.fd = -1;
+	return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+}
+//***************************************************************************
+int TCPUringListen(_sSocket_t socket)
+{
+	return _uringAddSocket(socket, true);
+}
+//***************************************************************************
+int TCPUringWatch(_sSocket_t socket)
+{
+	return _uringAddSocket(socket, false);
+}
+//***************************************************************************
+int TCPUringSend(_sSocket_t socket, const char *buffer, uint16_t len)
+{
+	struct _sUringSocket *ps;
+	int ret = ERRCODE_NO_ERROR;
+	int idx;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	idx = _uringFindSocket(socket);
+	if(idx < 0)
+	{
+		ret = ERRCODE_PARAMETRO_INVALIDO;
+		goto exit;
+	}
+
+	ps = &m_sUringWork.sockets[idx];
+	if(ps->u32Staged + len > TCP_URING_SEND_SZ)
+	{
+		ret = ERRCODE_TCP_WRITE_FAILED;
+		goto exit;
+	}
+	memcpy(_uringSendHalf(idx, ps->u8Stage) + ps->u32Staged, buffer, len);
+	ps->u32Staged += len;
+
+	if(!ps->bSendInFlight)
+		ret = _uringStartSend(idx);
+
+	// Fora da thread de eventos nao ha lote a aguardar
+	if((ret == ERRCODE_NO_ERROR) && !_uringInLoop())
+		ret = _uringSubmit();
+
+exit:
+	pthread_mutex_unlock(&m_sUringWork.lock);
+	return ret;
+}
+//***************************************************************************
+void TCPUringForget(_sSocket_t socket)
+{
+	int idx;
+
+	pthread_mutex_lock(&m_sUringWork.lock);
+	idx = _uringFindSocket(socket);
+	if(idx >= 0)
+	{
+		m_sUringWork.sockets[idx].bClosing = true;
+		m_sUringWork.sockets[idx].u32Staged = 0;
+		_uringTryRelease(idx);
+	}
+	pthread_mutex_unlock(&m_sUringWork.lock);
+}
+
+/******************************************************************************
+ * Local Functions code
+ *****************************************************************************/
+void* _TCPUringThreadLoop(void *arg)
+{
+	struct io_uring_cqe *cqe;
+	unsigned head, tail, pending;
+	uint64_t data;
+	int32_t res;
+	uint32_t flags;
+	int ret;
+
+	(void)arg;
+	while(1)
+	{
+		// Submete o lote acumulado e aguarda ao menos um evento na mesma chamada
+		pthread_mutex_lock(&m_sUringWork.lock);
+		pending = m_sUringWork.toSubmit;
+		pthread_mutex_unlock(&m_sUringWork.lock);
+
+		ret = _uringEnter(pending, 1, IORING_ENTER_GETEVENTS);
+		if(ret < 0)
+		{
+			if((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+				break;
+		}
+		else if(ret > 0)
+		{
+			pthread_mutex_lock(&m_sUringWork.lock);
+			m_sUringWork.toSubmit -= ((unsigned)ret > m_sUringWork.toSubmit) ? m_sUringWork.toSubmit : (unsigned)ret;
+			pthread_mutex_unlock(&m_sUringWork.lock);
+		}
+
+		head = *m_sUringWork.cqHead;
+		tail = __atomic_load_n(m_sUringWork.cqTail, __ATOMIC_ACQUIRE);
+		while(head != tail)
+		{
+			cqe = &m_sUringWork.cqes[head & *m_sUringWork.cqMask];
+			data = cqe->user_data;
+			res = cqe->res;
+			flags = cqe->flags;
+			head++;
+			__atomic_store_n(m_sUringWork.cqHead, head, __ATOMIC_RELEASE);
+
+			switch(TCP_URING_OP(data))
+			{
+			case _E_URING_OP_ACCEPT:
+				_uringHandleAccept(TCP_URING_IDX(data), res, flags);
+				break;
+			case _E_URING_OP_RECV:
+				_uringHandleRecv(TCP_URING_IDX(data), res, flags);
+				break;
+			case _E_URING_OP_SEND:
+				_uringHandleSend(TCP_URING_IDX(data), res);
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	// Se chegamos aqui, é uma excessao..
+	printf("End of thread io_uring: %s\n", strerror(errno));
+	sleep(1);
+	exit(EXIT_FAILURE);
+
+	return NULL;
+}
+
+#else /* TCP_HAVE_URING */
+
+/*****************************************************************************/
+int TCPUringInit(void)
+{
+	return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+}
+//***************************************************************************
+int TCPUringListen(_sSocket_t socket)
+{
+	(void)socket;
+	return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+}
+//***************************************************************************
+int TCPUringWatch(_sSocket_t socket)
+{
+	(void)socket;
+	return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+}
+//***************************************************************************
+int TCPUringSend(_sSocket_t socket, const char *buffer, uint16_t len)
+{
+	(void)socket;
+	(void)buffer;
+	(void)len;
+	return ERRCODE_TCP_ENGINE_UNAVAILABLE;
+}
+//***************************************************************************
+void TCPUringForget(_sSocket_t socket)
+{
+	(void)socket;
+}
+
+#endif /* TCP_HAVE_URING */
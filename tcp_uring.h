@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * @file    tcp_uring.h
+ * @author  Rafael Martins
+ * @brief   Motor io_uring da camada TCP (uso interno de tcp.c)
+ ******************************************************************************
+ */
+
+#ifndef TCP_URING_H_
+#define TCP_URING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tcp.h"
+
+/******************************************************************************/
+/**
+ * @brief Cria o anel io_uring, registra os buffers e inicia a thread de eventos.
+ * Falha caso o kernel nao suporte accept/recv multishot ou buffer rings.
+ *
+ * @return Codigo de erro
+ */
+int TCPUringInit(void);
+//***************************************************************************
+/**
+ * @brief Arma o accept multishot sobre um socket em listen
+ *
+ * @param socket - Socket do servidor
+ * @return Codigo de erro
+ */
+int TCPUringListen(_sSocket_t socket);
+//***************************************************************************
+/**
+ * @brief Arma o recv multishot (com buffer ring) sobre um socket conectado
+ *
+ * @param socket - Socket conectado
+ * @return Codigo de erro
+ */
+int TCPUringWatch(_sSocket_t socket);
+//***************************************************************************
+/**
+ * @brief Enfileira dados para envio. Envios feitos dentro de callbacks sao
+ * agrupados e submetidos juntos ao final do lote de eventos.
+ *
+ * @param socket - Handle do socket
+ * @param buffer - Ponteiro do buffer de envio de dados
+ * @param len - Tamanho dos dados de envio
+ * @return Codigo de erro
+ */
+int TCPUringSend(_sSocket_t socket, const char *buffer, uint16_t len);
+//***************************************************************************
+/**
+ * @brief Remove o socket do motor. Chamado por TCPDisconnect antes do close.
+ *
+ * @param socket - Handle do socket
+ */
+void TCPUringForget(_sSocket_t socket);
+
+/******************************************************************************
+ * Ganchos implementados em tcp.c, chamados pela thread de eventos
+ *****************************************************************************/
+/**
+ * @brief Nova conexao aceita pelo socket de listen
+ * @return true caso o client tenha sido aceito pelo servidor
+ */
+bool _TCPOnAccept(_sSocket_t listenSocket, _sSocket_t socket);
+/**
+ * @brief Dados recebidos em um socket
+ */
+void _TCPOnReceive(_sSocket_t socket, uint8_t *buffer, uint16_t len);
+/**
+ * @brief Conexao encerrada pelo ponto remoto ou por erro
+ */
+void _TCPOnClosed(_sSocket_t socket);
+
+#endif /* TCP_URING_H_ */
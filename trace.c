@@ -0,0 +1,260 @@
+/**
+ ******************************************************************************
+ * @file    trace.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include "trace.h"
+
+#ifdef TRACE_ENABLED
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "thread_wrapper.h"
+
+/******************************************************************************/
+// Anel de uma thread: produtor unico (a thread), consumidor unico (o dumper)
+struct _sTraceRing
+{
+	struct _sTraceRing *next;
+	uint32_t u32Tid;
+	bool bDead;					// Thread terminou; liberado apos a ultima descarga
+	uint32_t u32Head __attribute__((aligned(64)));	// Escrito pelo produtor
+	uint32_t u32Dropped;
+	uint32_t u32Tail __attribute__((aligned(64)));	// Escrito pelo dumper
+	struct sTraceRecord records[TRACE_RING_SZ];
+};
+
+// Estrutura de trabalho
+struct {
+	struct _sTraceRing *rings;	// Lista com insercao lock-free no inicio
+	FILE *file;
+	bool bTracing;
+	bool bStop;
+	sThread_t xthrDumpID;
+	pthread_key_t ringKey;
+} m_sTraceWork;
+
+static _Thread_local struct _sTraceRing *m_psRing = NULL;
+static pthread_once_t m_traceOnce = PTHREAD_ONCE_INIT;
+
+/*****************************************************************************/
+static inline uint64_t _traceTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+#endif
+}
+//***************************************************************************
+static uint64_t _traceNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+//***************************************************************************
+// Frequencia do contador: medida para o TSC, nanosegundos nos demais
+static uint64_t _traceTicksPerSec(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t ns0 = _traceNowNs();
+	uint64_t t0 = _traceTicks();
+
+	usleep(20000);
+	return (uint64_t)(((double)(_traceTicks() - t0) * 1e9) / (double)(_traceNowNs() - ns0));
+#else
+	return 1000000000ull;
+#endif
+}
+//***************************************************************************
+static void _traceThreadEnd(void *arg)
+{
+	__atomic_store_n(&((struct _sTraceRing*)arg)->bDead, true, __ATOMIC_RELEASE);
+}
+//***************************************************************************
+static void _traceCreateKey(void)
+{
+	pthread_key_create(&m_sTraceWork.ringKey, _traceThreadEnd);
+}
+//***************************************************************************
+// Primeiro evento da thread: cria e publica o seu anel
+static struct _sTraceRing* _traceNewRing(void)
+{
+	struct _sTraceRing *ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if(ring == NULL)
+		return NULL;
+	ring->u32Tid = (uint32_t)syscall(SYS_gettid);
+
+	pthread_once(&m_traceOnce, _traceCreateKey);
+	pthread_setspecific(m_sTraceWork.ringKey, ring);
+
+	ring->next = __atomic_load_n(&m_sTraceWork.rings, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&m_sTraceWork.rings, &ring->next, ring, true,
+										__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return ring;
+}
+//***************************************************************************
+void _traceRecord(uint32_t event, int32_t arg0, int32_t arg1)
+{
+	struct _sTraceRing *ring = m_psRing;
+	struct sTraceRecord *rec;
+	uint32_t head;
+
+	if(!__atomic_load_n(&m_sTraceWork.bTracing, __ATOMIC_RELAXED))
+		return;
+
+	if(ring == NULL)
+	{
+		ring = m_psRing = _traceNewRing();
+		if(ring == NULL)
+			return;
+	}
+
+	head = ring->u32Head;
+	if(head - __atomic_load_n(&ring->u32Tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SZ)
+	{
+		__atomic_fetch_add(&ring->u32Dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	rec = &ring->records[head & (TRACE_RING_SZ - 1)];
+	rec->u64Ticks = _traceTicks();
+	rec->u32Event = event;
+	rec->i32Arg0 = arg0;
+	rec->i32Arg1 = arg1;
+	__atomic_store_n(&ring->u32Head, head + 1, __ATOMIC_RELEASE);
+}
+//***************************************************************************
+// Copia para o arquivo o que cada anel acumulou e libera os aneis de threads encerradas
+static void _traceDump(void)
+{
+	struct _sTraceRing *ring;
+	struct _sTraceRing *prev = NULL;
+	struct _sTraceRing *next;
+	struct sTraceRecord dropped;
+	uint32_t head, tail, count, first;
+	uint32_t block[2];
+	bool dead;
+
+	for(ring = __atomic_load_n(&m_sTraceWork.rings, __ATOMIC_ACQUIRE); ring != NULL; ring = next)
+	{
+		next = ring->next;
+		dead = __atomic_load_n(&ring->bDead, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring->u32Head, __ATOMIC_ACQUIRE);
+		tail = ring->u32Tail;
+		count = head - tail;
+
+		if(count)
+		{
+			block[0] = ring->u32Tid;
+			block[1] = count;
+			fwrite(block, sizeof(block), 1, m_sTraceWork.file);
+
+			// O trecho pode dar a volta no fim do anel
+			first = TRACE_RING_SZ - (tail & (TRACE_RING_SZ - 1));
+			if(first > count)
+				first = count;
+			fwrite(&ring->records[tail & (TRACE_RING_SZ - 1)], sizeof(struct sTraceRecord), first, m_sTraceWork.file);
+			fwrite(&ring->records[0], sizeof(struct sTraceRecord), count - first, m_sTraceWork.file);
+			__atomic_store_n(&ring->u32Tail, head, __ATOMIC_RELEASE);
+		}
+
+		// Perdas contadas pelo produtor, registradas como um evento a parte
+		count = __atomic_exchange_n(&ring->u32Dropped, 0, __ATOMIC_RELAXED);
+		if(count)
+		{
+			dropped.u64Ticks = _traceTicks();
+			dropped.u32Event = TRACE_EV_DROPPED;
+			dropped.i32Arg0 = (int32_t)count;
+			dropped.i32Arg1 = 0;
+			dropped.u32Pad = 0;
+			block[0] = ring->u32Tid;
+			block[1] = 1;
+			fwrite(block, sizeof(block), 1, m_sTraceWork.file);
+			fwrite(&dropped, sizeof(dropped), 1, m_sTraceWork.file);
+		}
+
+		// O inicio da lista e disputado com as insercoes: so os demais sao removidos
+		if(dead && (prev != NULL) && (__atomic_load_n(&ring->u32Head, __ATOMIC_ACQUIRE) == head))
+		{
+			prev->next = next;
+			free(ring);
+			continue;
+		}
+		prev = ring;
+	}
+	fflush(m_sTraceWork.file);
+}
+//***************************************************************************
+static void* _traceThreadDump(void *arg)
+{
+	while(!__atomic_load_n(&m_sTraceWork.bStop, __ATOMIC_ACQUIRE))
+	{
+		usleep(TRACE_DUMP_PERIOD_MS * 1000);
+		_traceDump();
+	}
+	return NULL;
+}
+
+/*****************************************************************************/
+int traceStart(const char *path)
+{
+	struct sTraceFileHeader header;
+
+	if(m_sTraceWork.file != NULL)
+		return -1;
+
+	m_sTraceWork.file = fopen(path, "wb");
+	if(m_sTraceWork.file == NULL)
+		return -1;
+
+	header.u32Magic = TRACE_FILE_MAGIC;
+	header.u32Version = TRACE_FILE_VERSION;
+	header.u64TicksPerSec = _traceTicksPerSec();
+	header.u64StartTicks = _traceTicks();
+	fwrite(&header, sizeof(header), 1, m_sTraceWork.file);
+
+	m_sTraceWork.bStop = false;
+	if(threadCreate(&m_sTraceWork.xthrDumpID, "Trace", _traceThreadDump, NULL))
+	{
+		fclose(m_sTraceWork.file);
+		m_sTraceWork.file = NULL;
+		return -1;
+	}
+	__atomic_store_n(&m_sTraceWork.bTracing, true, __ATOMIC_RELEASE);
+	return 0;
+}
+//***************************************************************************
+void traceStop(void)
+{
+	if(m_sTraceWork.file == NULL)
+		return;
+
+	__atomic_store_n(&m_sTraceWork.bTracing, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&m_sTraceWork.bStop, true, __ATOMIC_RELEASE);
+	pthread_join(m_sTraceWork.xthrDumpID.handle, NULL);
+
+	_traceDump();
+	fclose(m_sTraceWork.file);
+	m_sTraceWork.file = NULL;
+}
+
+#endif /* TRACE_ENABLED */
@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ * @file    trace.h
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+// Registros por thread (potencia de 2); cheio, os novos eventos sao descartados e contados
+#define TRACE_RING_SZ				8192
+
+// Periodo de descarga dos aneis para o arquivo, em ms
+#define TRACE_DUMP_PERIOD_MS		100
+
+// Identificacao do arquivo
+#define TRACE_FILE_MAGIC			0x31435254u		// "TRC1"
+#define TRACE_FILE_VERSION			1
+
+// Eventos (a ordem faz parte do formato do arquivo)
+enum
+{
+	TRACE_EV_ACCEPT,						// a: socket, b: clients no servidor
+	TRACE_EV_READ,							// a: socket, b: bytes lidos
+	TRACE_EV_CALLBACK_ENTER,				// a: socket, b: bytes entregues
+	TRACE_EV_CALLBACK_EXIT,					// a: socket
+	TRACE_EV_SEND,							// a: socket, b: bytes
+	TRACE_EV_SHORT_WRITE,					// a: socket, b: bytes escritos
+	TRACE_EV_DISCONNECT,					// a: socket
+	TRACE_EV_SENSOR_READ_START,				// a: sensor, b: barramento
+	TRACE_EV_SENSOR_READ_END,				// a: sensor, b: 0 ou erro
+	TRACE_EV_DROPPED,						// a: eventos perdidos com o anel cheio
+	TRACE_EV_COUNT,
+};
+
+// Registro de um evento, gravado como esta no arquivo
+struct sTraceRecord
+{
+	uint64_t u64Ticks;			// Contador de tempo (ver u64TicksPerSec do cabecalho)
+	uint32_t u32Event;
+	int32_t i32Arg0;
+	int32_t i32Arg1;
+	uint32_t u32Pad;
+};
+
+// Cabecalho do arquivo; seguido de blocos {uint32 tid, uint32 count, count registros}
+struct sTraceFileHeader
+{
+	uint32_t u32Magic;
+	uint32_t u32Version;
+	uint64_t u64TicksPerSec;
+	uint64_t u64StartTicks;
+};
+
+/*****************************************************************************/
+#ifdef TRACE_ENABLED
+
+/**
+ * @brief Grava um evento no anel da thread corrente, sem lock. Usar a macro
+ * TRACE, removida por completo sem TRACE_ENABLED.
+ */
+void _traceRecord(uint32_t event, int32_t arg0, int32_t arg1);
+
+#define TRACE(event, arg0, arg1)	_traceRecord((event), (int32_t)(arg0), (int32_t)(arg1))
+
+//***************************************************************************
+/**
+ * @brief Inicia a captura e a thread que descarrega os aneis no arquivo
+ *
+ * @param path - Arquivo de saida (converter com trace2json)
+ * @return 0 em caso de sucesso
+ */
+int traceStart(const char *path);
+
+//***************************************************************************
+/**
+ * @brief Encerra a captura, descarregando o que restar nos aneis
+ */
+void traceStop(void);
+
+#else
+
+#define TRACE(event, arg0, arg1)	((void)0)
+
+static inline int traceStart(const char *path)
+{
+	(void)path;
+	return -1;
+}
+
+static inline void traceStop(void)
+{
+}
+
+#endif /* TRACE_ENABLED */
+
+#endif /* TRACE_H_ */
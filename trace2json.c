@@ -0,0 +1,98 @@
+/**
+ ******************************************************************************
+ * @file    trace2json.c
+ * @author  Rafael Martins
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+/**
+ * @note Conversao do arquivo gravado com --trace para o formato JSON do
+ * Chrome (chrome://tracing) e do Perfetto (ui.perfetto.dev):
+ * ./trace2json trace.bin > trace.json
+ */
+
+// Nome e fase de cada evento: 'B'/'E' abrem e fecham um intervalo, 'i' e instantaneo
+static const struct
+{
+	const char *name;
+	char phase;
+} m_sEvents[TRACE_EV_COUNT] =
+{
+	[TRACE_EV_ACCEPT]				= {"accept", 'i'},
+	[TRACE_EV_READ]					= {"read", 'i'},
+	[TRACE_EV_CALLBACK_ENTER]		= {"callback", 'B'},
+	[TRACE_EV_CALLBACK_EXIT]		= {"callback", 'E'},
+	[TRACE_EV_SEND]					= {"send", 'i'},
+	[TRACE_EV_SHORT_WRITE]			= {"short write", 'i'},
+	[TRACE_EV_DISCONNECT]			= {"disconnect", 'i'},
+	[TRACE_EV_SENSOR_READ_START]	= {"sensor read", 'B'},
+	[TRACE_EV_SENSOR_READ_END]		= {"sensor read", 'E'},
+	[TRACE_EV_DROPPED]				= {"dropped", 'i'},
+};
+
+int main(int argc, char *argv[])
+{
+	struct sTraceFileHeader header;
+	struct sTraceRecord rec;
+	uint32_t block[2];
+	const char *sep = "";
+	double usPerTick;
+	FILE *file;
+
+	if(argc != 2)
+	{
+		printf("Usage: %s <trace file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	file = fopen(argv[1], "rb");
+	if(file == NULL)
+	{
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if((fread(&header, sizeof(header), 1, file) != 1) ||
+		(header.u32Magic != TRACE_FILE_MAGIC) || (header.u32Version != TRACE_FILE_VERSION) ||
+		(header.u64TicksPerSec == 0))
+	{
+		fprintf(stderr, "%s: not a trace file\n", argv[1]);
+		fclose(file);
+		return EXIT_FAILURE;
+	}
+	usPerTick = 1e6 / (double)header.u64TicksPerSec;
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	while(fread(block, sizeof(block), 1, file) == 1)
+	{
+		for(uint32_t i = 0; i < block[1]; i++)
+		{
+			if(fread(&rec, sizeof(rec), 1, file) != 1)
+			{
+				fprintf(stderr, "%s: truncated block\n", argv[1]);
+				goto end;
+			}
+			if(rec.u32Event >= TRACE_EV_COUNT)
+				continue;
+
+			printf("%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%" PRIu32,
+				   sep, m_sEvents[rec.u32Event].name, m_sEvents[rec.u32Event].phase,
+				   (double)(int64_t)(rec.u64Ticks - header.u64StartTicks) * usPerTick, block[0]);
+			if(m_sEvents[rec.u32Event].phase == 'i')
+				printf(",\"s\":\"t\"");
+			printf(",\"args\":{\"a\":%" PRId32 ",\"b\":%" PRId32 "}}", rec.i32Arg0, rec.i32Arg1);
+			sep = ",";
+		}
+	}
+
+end:
+	printf("\n]}\n");
+	fclose(file);
+	return EXIT_SUCCESS;
+}